@@ -2,7 +2,7 @@
 // mem.h
 //
 // Provides a foundational layer with memory and dynamic buffers management for C applications
-// on Windows, based on the virtual memory facilities provided by the platform
+// on Windows and POSIX systems, based on the virtual memory facilities provided by the platform
 //
 // This is an header-only library: include this header whenever you need the interface, definining
 // the MEM_IMPLEMENTATION macro ONLY once to compile the implementation
@@ -60,14 +60,40 @@
 // Note that we might switch to intrinsic traps in the future.
 //      MEM_ASSERT(x)
 //
+// On POSIX systems the implementation relies on mmap extensions (e.g. MAP_ANONYMOUS) which are not
+// exposed in strict ISO C mode: define _DEFAULT_SOURCE (or _GNU_SOURCE) before including any system
+// header in the translation unit that compiles the implementation.
+//
+// The thread-local scratch arenas (see memGetScratch) can be tuned by defining the number of arenas
+// per thread and the size reserved for each of them:
+//      MEM_SCRATCH_COUNT
+//      MEM_SCRATCH_SIZE
+//
+// Usage statistics (see memGetStats) are collected only if the following macro is defined, so that
+// they have no cost otherwise:
+//      MEM_ENABLE_STATS
+//
+// Likewise, USDT probes for dynamic tracing tools (e.g. bpftrace, perf, SystemTap) are compiled in
+// only if the following macro is defined; this requires the <sys/sdt.h> header from SystemTap, and
+// a probe which is not attached costs a single no-op instruction, but the inline fast path (see
+// memAllocFast) is disabled so that all the allocations fire the probes. The probes are listed in
+// the implementation, along with the MEM_PROBE macros.
+//      MEM_ENABLE_USDT
+//
+// Hardware and software performance counters (see memGetPerf) are attributed to the arena
+// operations only if the following macro is defined, since each measurement costs a few syscalls:
+//      MEM_ENABLE_PERF
+//
 // All of the above applies for the implementation only, so those macros must be defined ONCE, along
 // the MEM_IMPLEMENTATION one.
 // The interface relies on C standard types, which are pure definitions (so no runtime
 // dependencies), and is not configurable (sorry folks, it's 2023 and we should agree on something).
+// The only exception is <stdio.h>, for the FILE type used by the registry report (memDumpArenas).
 
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 //=== Macros ===//
 
@@ -114,6 +140,24 @@ typedef struct MemBlock
 // \endcode
 typedef struct MemArena MemArena;
 
+// Leading portion of the arena state, exposed only for the benefit of the inline allocation fast
+// path (see memAllocFast). Must be considered read-only.
+typedef struct MemArenaHead
+{
+    uint8_t *ptr;
+    size_t len;
+    // Allocations ending within this limit can be served by just bumping the length, because the
+    // memory is already committed and clear; maintained by the implementation, 0 disables the
+    // fast path.
+    size_t fast_cap;
+} MemArenaHead;
+
+enum
+{
+    // Size of the buffer storing the name of a registered arena, including the terminator
+    MEM_ARENA_NAME_LEN = 32,
+};
+
 typedef struct MemArenaInfo
 {
     // Total allocation size, including space required for the allocator data structure.
@@ -125,9 +169,88 @@ typedef struct MemArenaInfo
     // structure)
     size_t available_size;
 
+    // Granularity of commit operations: memory is committed in chunks of this size (e.g. 64 KB or
+    // 2 MB) in order to reduce the number of syscalls on growth. Must be a power of 2; it is
+    // rounded up to the page size, which is also the default if initialized to 0.
+    size_t commit_size;
+
+    // Amount of committed but unused memory tolerated before it is decommitted on shrink. This
+    // avoids a syscall per operation when the usage oscillates around a commit boundary.
+    // If initialized to 0, unused memory is decommitted immediately (see memTrim for explicit
+    // decommits).
+    size_t decommit_threshold;
+
     // Set this flag to avoid protection of unused memory (may improve performance is memFree and
     // memResize are called often).
     bool unsafe;
+
+    // Set this flag to avoid clearing released memory to zero. Zeroing is deferred to the
+    // allocation functions that guarantee it (memAlloc, memResize) and limited to memory that was
+    // actually used before, so that the "Uninit" variants never pay for it (e.g. when reusing the
+    // arena after memClear).
+    bool no_zero;
+
+    // Set this flag to share the arena across threads without external synchronization: memAlloc,
+    // memResize, memFree (and their variants) and memAvailable become lock-free, with a single
+    // thread at a time issuing the commit syscalls. Memory released by shrinking a block in this
+    // mode is cleared when allocated again, so that a failed operation leaves the block intact.
+    // memClear, memTrim and memRestore still require exclusive access to the arena.
+    bool concurrent;
+
+    // Set this flag to let the arena grow past its reservation: when exhausted, a new block of
+    // virtual memory is reserved and linked to the current one. A single allocation never spans
+    // multiple blocks, and memResize only works within the current block. Savepoints work across
+    // blocks, and rolling back releases the blocks that are no longer used.
+    // Not compatible with the concurrent mode.
+    bool chained;
+
+    // Keep the blocks of a chained arena reserved (but decommitted) when they are rolled back by
+    // memClear or memRestore, in order to reuse them on further growth; by default all the blocks
+    // except the first are released.
+    bool chain_retain;
+
+    // Growth factor of the capacity of each chained block with respect to the previous one; if
+    // initialized to 0, a factor of 2 is used. If the address space is exhausted, the block is
+    // reserved with the minimum size required by the allocation.
+    uint8_t chain_grow_f;
+
+    // Path of a file backing the arena, which makes it persistent: the file is mapped at
+    // /param base_address and stores the allocator data structure in its first page, so that
+    // reopening it in another process restores the arena with all the pointers into it still
+    // valid. If the file is not empty the arena is restored from it, ignoring all the other
+    // options except /param shared; this fails if the file was not created by a compatible build,
+    // at the same address and with the same /param shared flag, or if the address range is
+    // already in use.
+    // Not compatible with the chained mode. Supported on POSIX systems only.
+    char const *file_path;
+
+    // Address of a persistent arena, must be page aligned
+    void *base_address;
+
+    // Set this flag to share the arena across processes: the memory is mapped from an anonymous
+    // shared memory object, which child processes inherit (e.g. prefork workers), or from the file
+    // given by /param file_path, which unrelated processes open at the same address like a
+    // persistent arena (use a memory file system such as /dev/shm for non-persistent sharing); in
+    // this case the file must be created before other processes open it.
+    // The allocator data structure lives in the shared memory and allocations work across processes
+    // as in the concurrent mode, which is implied. Links between allocations can be stored as
+    // offsets (see MemRef), so that the data is also valid if mapped elsewhere (e.g. read-only).
+    // The whole reservation is accessible from the start; memRelease only unmaps the memory from
+    // the calling process. Supported on POSIX systems only.
+    bool shared;
+
+    // Set this flag to back the arena memory with an anonymous file (memfd on Linux), so that it
+    // can be cloned by memClone. Not compatible with the chained mode. On systems without support
+    // for anonymous files the arena is reserved as usual, but cannot be cloned.
+    bool cloneable;
+
+    // Name of the arena in the process-wide registry (see memForEachArena), along with a user
+    // defined tag (e.g. to group arenas by subsystem); the arena is registered only if a name is
+    // given, which is copied (truncated to MEM_ARENA_NAME_LEN - 1 characters). The name of
+    // persistent arenas is stored along with them, and clones inherit it. Not supported for shared
+    // arenas.
+    char const *name;
+    uint32_t tag;
 } MemArenaInfo;
 
 // Reserve virtual memory to allocate from, with some space reserved to the allocator data structure
@@ -135,36 +258,614 @@ typedef struct MemArenaInfo
 MEM_API MemArena *memReserve(MemArenaInfo const *info);
 
 // Release the whole virtual memory block, rendering the allocator unusable.
+// The content of persistent arenas is retained in the backing file.
 MEM_API void memRelease(MemArena *mem);
 
+// Create a copy-on-write clone of an arena reserved with the "cloneable" flag: the clone shares the
+// memory pages of the original until either of them writes to them, so that cloning costs page
+// table work instead of a full copy. The clone is an independent arena (which cannot be cloned in
+// turn) and must be released with memRelease.
+// The original must not be modified while it has clones, because pages not written by a clone yet
+// would reflect the changes (e.g. clone a frozen base state to explore speculative branches).
+// Returns NULL if the arena is not cloneable or the mapping fails.
+MEM_API MemArena *memClone(MemArena *mem);
+
+// Flush the content of a persistent arena (or of the persistent arena a child was forked from) to
+// the backing file, returning false on failure; the file can be reopened consistently only from
+// the state of the last successful call. No-op for other arenas.
+MEM_API bool memSync(MemArena *mem);
+
 // Clears the total allocated memory all at once. If the safety features are enabled, the memory is
 // also decommited in order to trigger access violations on use. The allocator is reset and still
 // usable for further allocations.
+// Chained arenas go back to their first block, releasing (or retaining) the others.
 MEM_API void memClear(MemArena *mem);
 
-// Allocate a block of memory with the given size and alignment
+// Decommit the unused memory, keeping at most the given amount of committed memory past the
+// allocated one. Unlike the automatic decommit policy, this ignores both the decommit threshold and
+// the "unsafe" flag.
+MEM_API void memTrim(MemArena *mem, size_t keep_bytes);
+
+// Allocate a block of memory with the given size and alignment, cleared to zero
 MEM_API MemBlock memAlloc(MemArena *mem, size_t len, size_t alignment);
 
-// Try to resize the given memory block in place
+// Allocate a block of memory with the given size and alignment, without guaranteeing its content.
+// Useful for blocks that are overwritten right away (e.g. copy destinations).
+MEM_API MemBlock memAllocUninit(MemArena *mem, size_t len, size_t alignment);
+
+// Try to resize the given memory block in place; the grown part of the block is cleared to zero
 MEM_API bool memResize(MemArena *mem, MemBlock *block, size_t new_len);
 
+// Try to resize the given memory block in place, without guaranteeing the content of the grown part
+MEM_API bool memResizeUninit(MemArena *mem, MemBlock *block, size_t new_len);
+
 // Try to free the given memory block; since allocations are handed out in a linear fashion,
 // this operation may not succeed. In this case the block is leaked until the entire allocation
 // is cleared.
 #define memFree(mem, block) memResize(mem, block, 0)
 
-// Query the memory still available in the arena
+// Query the memory still available in the arena (for chained arenas, the memory available in the
+// current block, i.e. without reserving a new one)
 MEM_API size_t memAvailable(MemArena *mem);
 
+// Savepoint of the arena state, see memSave and memRestore
+typedef struct MemArenaMark
+{
+    // Allocated size at the savepoint (for chained arenas, including all the previous blocks)
+    size_t pos;
+} MemArenaMark;
+
+// Save the current state of the arena, in order to roll back all the allocations performed
+// after this point with a single memRestore call
+MEM_API MemArenaMark memSave(MemArena *mem);
+
+// Roll back all the allocations performed after the given savepoint was taken, applying the commit
+// policy once. Savepoints taken after the given one are invalidated.
+MEM_API void memRestore(MemArena *mem, MemArenaMark mark);
+
+//=== Double-ended arenas ===//
+
+// Any arena can also allocate from the back end of its memory, growing downward, with its own
+// cursor and commit tracking. This allows, for example, to keep long-lived results on the front end
+// and temporaries on the back end, resetting the latter independently.
+// The back end is not supported by concurrent or chained arenas; it always clears released memory,
+// and memAvailable reports the memory left between the two ends. memClear resets both ends.
+
+// Allocate a block of memory with the given size and alignment from the back end, cleared to zero
+MEM_API MemBlock memAllocBack(MemArena *mem, size_t len, size_t alignment);
+
+// Save the current state of the back end
+MEM_API MemArenaMark memSaveBack(MemArena *mem);
+
+// Roll back all the allocations performed from the back end after the given savepoint was taken
+MEM_API void memRestoreBack(MemArena *mem, MemArenaMark mark);
+
+// Clear all the allocations performed from the back end, leaving the front end untouched
+#define memClearBack(mem) memRestoreBack(mem, (MemArenaMark){0})
+
+// Inline fast path for memAlloc: if the allocation fits the memory already committed, the block is
+// handed out by just bumping the arena length, otherwise memAlloc is called.
+// Since the function is inlined, compile-time constant alignments are folded by the compiler; the
+// checks are written to keep the common case down to a handful of instructions.
+static inline MemBlock
+memAllocFast(MemArena *mem, size_t len, size_t alignment)
+{
+    MemArenaHead *head = (MemArenaHead *)mem;
+    size_t fast_cap = head->fast_cap;
+
+    // NOTE (Matteo): The fast path is always disabled for concurrent arenas, whose length must not
+    // be read here since other threads update it atomically
+    if (fast_cap)
+    {
+        size_t base = (size_t)head->ptr;
+        size_t offset = ((base + head->len + (alignment - 1)) & ~(alignment - 1)) - base;
+
+        if (len && offset <= fast_cap && len <= fast_cap - offset)
+        {
+            MemBlock block;
+            block.ptr = head->ptr + offset;
+            block.len = len;
+            head->len = offset + len;
+            return block;
+        }
+    }
+
+    return memAlloc(mem, len, alignment);
+}
+
 // Allocate a block of memory to store a struct of the given type and return
 // a direct pointer to it (instead of the raw memory block)
-#define memAllocStruct(mem, T) (T *)(memAlloc(mem, sizeof(T), MEM_ALIGNOF(T)).ptr)
+#define memAllocStruct(mem, T) (T *)(memAllocFast(mem, sizeof(T), MEM_ALIGNOF(T)).ptr)
 
 // Try to free the memory block allocated for the pointed struct. Type information
 // not required because the size is inferred from the pointer.
 #define memFreeStruct(mem, item_ptr) \
     memResize(mem, &(MemBlock){.ptr = (void *)(item_ptr), .len = sizeof(*ptr)}, 0)
 
+//=== Compressed references ===//
+
+// Compact alternative to pointers for data structures that live in a single arena: a 32-bit offset
+// from the start of the arena memory (the current block for chained arenas), optionally scaled by
+// the alignment of the referenced data. Unscaled references address 4 GB; scaling by 4 or 8 bytes
+// raises the limit to 16 or 32 GB.
+// References are independent from the arena address, so they survive snapshots (see
+// memSnapshotWrite) and shared mappings without fix ups.
+// Zero-initialize for the null reference.
+typedef struct MemRef
+{
+    uint32_t val;
+} MemRef;
+
+// Shift of the references scaled by the alignment of the given type (up to 8 bytes)
+#define MEM_REF_SHIFT(T) \
+    (MEM_ALIGNOF(T) >= 8 ? 3u : MEM_ALIGNOF(T) >= 4 ? 2u : MEM_ALIGNOF(T) >= 2 ? 1u : 0u)
+
+// Encode a pointer into the arena memory as a reference scaled by (1 << shift); the pointer must be
+// aligned accordingly and within range (asserted). NULL is encoded as the null reference.
+MEM_API MemRef memRefEncodeScaled(MemArena *mem, void const *ptr, uint32_t shift);
+
+// Decode a reference scaled by (1 << shift); the null reference is decoded as NULL
+static inline void *
+memRefDecodeScaled(MemArena *mem, MemRef ref, uint32_t shift)
+{
+    MemArenaHead *head = (MemArenaHead *)mem;
+    return ref.val ? head->ptr + ((size_t)(ref.val - 1) << shift) : NULL;
+}
+
+// Unscaled references
+#define memRefEncode(mem, ptr) memRefEncodeScaled(mem, ptr, 0)
+#define memRefDecode(mem, ref) memRefDecodeScaled(mem, ref, 0)
+
+// Typed references, scaled by the alignment of the given type
+#define memRefOf(mem, T, ptr) memRefEncodeScaled(mem, ptr, MEM_REF_SHIFT(T))
+#define memRefGet(mem, T, ref) ((T *)memRefDecodeScaled(mem, ref, MEM_REF_SHIFT(T)))
+
+//=== Statistics ===//
+
+typedef struct MemArenaStats
+{
+    // Number of successful allocations (from either end) and resizes, and of free operations
+    // (i.e. resizes to 0) with the number of failures among them
+    size_t allocs, resizes, frees, failed_frees;
+    // Bytes skipped to satisfy alignment requirements
+    size_t align_padding;
+    // Bytes leaked by memReallocBufEx, when a buffer is moved and the previous one cannot be freed
+    size_t realloc_leaked;
+    // Number of commit and decommit operations (i.e. syscalls) and bytes involved
+    size_t commits, commit_bytes;
+    size_t decommits, decommit_bytes;
+    // Current and peak allocated size (for chained arenas, including the previous blocks)
+    size_t len, peak_len;
+    // Current and peak committed size of the arena (for chained arenas, of the current block)
+    size_t commit, peak_commit;
+} MemArenaStats;
+
+// Query the usage statistics of the arena, which are collected only if the implementation is
+// compiled with MEM_ENABLE_STATS defined; in that case the inline fast path is disabled, so that
+// all the allocations are accounted for. Returns false (with cleared statistics) otherwise.
+MEM_API bool memGetStats(MemArena *mem, MemArenaStats *stats);
+
+// Reset the peak values to the current ones, e.g. to track the high-water mark of each request
+MEM_API void memResetPeak(MemArena *mem);
+
+//=== Performance counters ===//
+
+typedef enum MemPerfOp
+{
+    // Commit and decommit syscalls
+    MEM_PERF_COMMIT,
+    MEM_PERF_DECOMMIT,
+    // First write to the pages of an allocation after they are committed, which the allocator
+    // performs itself (i.e. pre-faulting the pages) in order to measure it
+    MEM_PERF_FIRST_TOUCH,
+    // Zeroing of released memory (e.g. by memClear), or of reused memory at allocation time for
+    // arenas with the no_zero option
+    MEM_PERF_ZERO,
+    MEM_PERF_OP_COUNT,
+} MemPerfOp;
+
+enum
+{
+    // Counters available to the calling thread (see MemPerfStats)
+    MEM_PERF_PAGE_FAULTS = 0x1,
+    MEM_PERF_DTLB_MISSES = 0x2,
+    MEM_PERF_CYCLES = 0x4,
+};
+
+typedef struct MemPerfCounters
+{
+    // Number of operations measured and total wall-clock time in nanoseconds
+    size_t count, time_ns;
+    // Page faults, dTLB load misses and CPU cycles (including the kernel if permitted), 0 if the
+    // counter is not available
+    size_t page_faults, dtlb_misses, cycles;
+} MemPerfCounters;
+
+typedef struct MemPerfStats
+{
+    MemPerfCounters ops[MEM_PERF_OP_COUNT];
+    // Counters available to the calling thread, as a combination of MEM_PERF_PAGE_FAULTS etc.
+    uint32_t available;
+} MemPerfStats;
+
+// Query the performance counters attributed to each operation of the arena (see MemPerfOp), which
+// are collected only if the implementation is compiled with MEM_ENABLE_PERF defined; in that case
+// the inline fast path is disabled. The counters are read with perf_event_open on Linux, for each
+// thread; elsewhere, or if the kernel denies access, only the operations and their time are
+// measured. Returns false (with cleared counters) if not enabled.
+MEM_API bool memGetPerf(MemArena *mem, MemPerfStats *perf);
+
+// Reset the performance counters of the arena
+MEM_API void memResetPerf(MemArena *mem);
+
+// Close the performance counters of the calling thread (e.g. before the thread exits)
+MEM_API void memReleaseThreadPerf(void);
+
+//=== Tracing ===//
+
+typedef enum MemTraceKind
+{
+    MEM_TRACE_ALLOC = 1,
+    MEM_TRACE_RESIZE,
+    MEM_TRACE_CLEAR,
+    MEM_TRACE_COMMIT,
+    MEM_TRACE_DECOMMIT,
+} MemTraceKind;
+
+typedef struct MemTraceEvent
+{
+    // NOTE (Matteo): Sequence number of the event plus 1, written last (0 while being written)
+    size_t seq;
+    // Monotonic timestamp and duration (commit and decommit only) in nanoseconds
+    uint64_t time, duration;
+    // Offset of the memory from the start of the arena memory, with its size (the new size for
+    // resizes, the previous length for clear events) and alignment (allocations only)
+    ptrdiff_t offset;
+    size_t size, alignment;
+    MemTraceKind kind;
+} MemTraceEvent;
+
+// Bounded ring of the most recent events of one or more arenas (see memSetTrace). Recording is
+// lock-free, so that tracing can be left on in production; older events are overwritten.
+// Initialize with memTraceInit.
+typedef struct MemTrace
+{
+    MemTraceEvent *events;
+    size_t cap;
+    size_t next;
+} MemTrace;
+
+// Initialize a trace ring with room for at least the given number of events (rounded up to a power
+// of 2), allocated from the given arena; returns false if the allocation fails
+MEM_API bool memTraceInit(MemTrace *trace, MemArena *mem, size_t capacity);
+
+// Record the events of the arena to the given trace ring (NULL stops recording): allocations,
+// resizes and frees, memClear calls, and commit/decommit syscalls with their duration. The inline
+// fast path is disabled while recording. Requires exclusive access to the arena, like memClear;
+// not supported for shared arenas.
+MEM_API void memSetTrace(MemArena *mem, MemTrace *trace);
+
+// Render the events currently stored in the trace ring as Chrome trace JSON (which can be loaded by
+// Perfetto or chrome://tracing), allocated from the given arena and terminated by a NUL character
+// not included in the block length. Events being overwritten concurrently are skipped.
+MEM_API MemBlock memTraceExport(MemTrace *trace, MemArena *dst);
+
+//=== Heap profiling ===//
+
+enum
+{
+    // Maximum number of frames in the call stacks captured by the heap profiler
+    MEM_PROFILE_MAX_DEPTH = 24,
+};
+
+typedef enum MemProfileFormat
+{
+    // Legacy pprof heap profile, with the process memory map appended for symbolization
+    MEM_PROFILE_PPROF,
+    // Folded stacks (as consumed by flamegraph.pl), weighted by live or cumulative bytes; frames
+    // are raw return addresses, outermost first
+    MEM_PROFILE_FOLDED_LIVE,
+    MEM_PROFILE_FOLDED_TOTAL,
+} MemProfileFormat;
+
+// Allocations attributed to a single call stack, as estimated from the samples
+typedef struct MemProfileSite
+{
+    // Return addresses, innermost first (allocator frames included)
+    void *frames[MEM_PROFILE_MAX_DEPTH];
+    uint32_t depth;
+    // Estimated number and size of the allocations still live and since profiling started
+    size_t live_count, live_bytes;
+    size_t total_count, total_bytes;
+} MemProfileSite;
+
+// Sampled allocation still live in a profiled arena
+typedef struct MemProfileSample
+{
+    MemArena *arena;
+    // Position of the sampled memory from the start of the arena (front end) or length of the back
+    // end after the allocation; the memory is released when the arena shrinks past it
+    size_t pos;
+    size_t count, bytes;
+    uint32_t site;
+    bool back;
+} MemProfileSample;
+
+// Sampling heap profiler for one or more arenas (see memSetProfile). About one allocation every
+// 'period' bytes captures its call stack, and the samples are aggregated by call site with an
+// estimate of the live and cumulative bytes; allocations at least as large as the period are always
+// sampled. The tables are bounded, and samples that do not fit are dropped. Call stacks are
+// captured on Windows, glibc and macOS; elsewhere all samples are attributed to a single site.
+// Initialize with memProfileInit.
+typedef struct MemProfile
+{
+    MemProfileSite *sites;
+    MemProfileSample *live;
+    size_t site_cap, site_len;
+    size_t live_cap, live_len;
+    size_t period;
+    // Number of samples dropped because the tables were full
+    size_t dropped;
+    size_t lock;
+} MemProfile;
+
+// Initialize a heap profiler sampling about once every 'period' bytes (rounded up to a power of 2),
+// with room for the given number of call sites and live samples, allocated from the given arena;
+// returns false if the allocation fails
+MEM_API bool memProfileInit(MemProfile *profile, MemArena *mem, size_t period, size_t capacity);
+
+// Sample the allocations of the arena to the given profiler (NULL stops sampling, releasing the
+// live samples of the arena): allocations from either end and growth by resizing. The inline fast
+// path is disabled while sampling. Requires exclusive access to the arena, like memClear; not
+// supported for shared arenas.
+MEM_API void memSetProfile(MemArena *mem, MemProfile *profile);
+
+// Render the profile in the given format, allocated from the given arena and terminated by a NUL
+// character not included in the block length
+MEM_API MemBlock memProfileExport(MemProfile *profile, MemArena *dst, MemProfileFormat format);
+
+//=== Arena registry ===//
+
+// Usage of a registered arena, as observed by memForEachArena; values are read while the arena may
+// be in use by other threads, so they are approximate
+typedef struct MemArenaReport
+{
+    MemArena *arena;
+    char const *name;
+    uint32_t tag;
+    // Reserved and committed memory (for chained arenas, of the current block)
+    size_t reserved, committed;
+    // Allocated size from both ends (for chained arenas, including the previous blocks) and peak
+    // committed size, which is tracked only if statistics are enabled (0 otherwise)
+    size_t used, peak;
+} MemArenaReport;
+
+typedef void (*MemArenaVisitor)(MemArenaReport const *report, void *context);
+
+// Invoke the visitor for each registered arena, most recently registered first, and return the
+// number of arenas. The registry is locked in the meantime, so the visitor must not reserve or
+// release registered arenas.
+MEM_API size_t memForEachArena(MemArenaVisitor visitor, void *context);
+
+// Write a text report of the registered arenas (name, tag, reserved, committed, used and peak
+// bytes), one per line after a header, followed by the totals
+MEM_API void memDumpArenas(FILE *stream);
+
+//=== Fork/join ===//
+
+// Create a child arena with the given available size, carved out of the unused memory of the
+// parent. No new virtual memory is reserved and the child data structure is stored in its own first
+// page, so forking is cheap; the child inherits the commit policy and options of the parent (except
+// for the concurrent mode), and can be handed over to another thread.
+// The parent cannot allocate in the child range, so that both arenas can be used without
+// contention; returns NULL if the parent has not enough memory available.
+// Forking and joining require exclusive access to the parent, like memClear.
+MEM_API MemArena *memFork(MemArena *parent, size_t size);
+
+// Join a child arena created by memFork, rendering it unusable. The memory allocated from the child
+// is either folded back into the parent (and stays valid, with no copies involved) or discarded.
+// If the child is the last allocation of the parent, its unused memory is given back too; otherwise
+// it is leaked until the parent is cleared, like any block that memFree cannot release.
+MEM_API void memJoin(MemArena *child, bool discard);
+
+//=== Pool allocator ===//
+
+// Allocator of fixed-size slots, carved from a MemArena in page-sized batches and recycled through
+// an intrusive free list, so that objects with random lifetimes can be freed in any order.
+// Zero-initialize and call memPoolInit before use.
+typedef struct MemPool
+{
+    MemArena *mem;
+    size_t slot_size, slot_align;
+    // NOTE (Matteo): Freed slots, linked through their first bytes
+    void *free_list;
+    // NOTE (Matteo): Unused part of the current batch
+    uint8_t *batch_ptr;
+    size_t batch_len;
+} MemPool;
+
+// Initialize the pool to allocate slots of the given size and alignment from the given arena
+MEM_API void memPoolInit(MemPool *pool, MemArena *mem, size_t slot_size, size_t slot_alignment);
+
+// Allocate a slot, cleared to zero; returns NULL if the backing arena is exhausted
+MEM_API void *memPoolAlloc(MemPool *pool);
+
+// Give the slot back to the pool for recycling
+MEM_API void memPoolFree(MemPool *pool, void *slot);
+
+// Forget all the slots at once; intended to be paired with clearing (or rolling back) the backing
+// arena, which actually gives the memory back:
+//
+// \code{.c}
+// memClear(mem);
+// memPoolReset(&pool);
+// \endcode
+MEM_API void memPoolReset(MemPool *pool);
+
+// Allocate a pool slot and return it as a pointer to the given type
+#define memPoolAllocStruct(pool, T) ((T *)memPoolAlloc(pool))
+
+//=== Slab allocator ===//
+
+enum
+{
+    // Size classes are powers of 2 and midpoints between them (16, 24, 32, 48, 64 ... 32K)
+    MEM_SLAB_MIN_SIZE = 16,
+    MEM_SLAB_MAX_SIZE = 32768,
+    MEM_SLAB_CLASSES = 23,
+};
+
+// General purpose allocator for small objects, with O(1) allocation and deallocation in any order.
+// Each size class is served by a pool backed by its own arena, forked from a parent arena, so that
+// the size class of a pointer is deduced from its address and the whole allocator can be reset at
+// once. Zero-initialize and call memSlabInit before use.
+typedef struct MemSlab
+{
+    MemPool pools[MEM_SLAB_CLASSES];
+    uint8_t *base;
+    size_t run_size;
+} MemSlab;
+
+// Initialize the allocator, forking an arena of the given size for each size class from the given
+// parent arena. Returns false if the parent has not enough memory available.
+MEM_API bool memSlabInit(MemSlab *slab, MemArena *parent, size_t class_size);
+
+// Join all the size class arenas back into the parent, discarding their content
+MEM_API void memSlabRelease(MemSlab *slab);
+
+// Free all the allocations at once
+MEM_API void memSlabReset(MemSlab *slab);
+
+// Allocate a block of the given size (up to MEM_SLAB_MAX_SIZE), cleared to zero; blocks are aligned
+// to the largest power of 2 that divides their size class, up to 16 bytes.
+// Returns NULL if the size is not supported or the size class arena is exhausted.
+MEM_API void *memSlabAlloc(MemSlab *slab, size_t size);
+
+// Free a block allocated by memSlabAlloc
+MEM_API void memSlabFree(MemSlab *slab, void *ptr);
+
+//=== TLSF allocator ===//
+
+enum
+{
+    MEM_TLSF_SL_COUNT = 16,
+    MEM_TLSF_FL_COUNT = 32,
+};
+
+typedef struct MemTlsfBlock MemTlsfBlock;
+
+// Two-level segregated fit allocator: general purpose allocation, deallocation and reallocation in
+// any order, with O(1) bounded time. The allocator manages a single contiguous region of its own
+// arena, which grows on demand; the memory of large free spans is given back by decommitting it.
+// Zero-initialize and call memTlsfInit before use.
+typedef struct MemTlsf
+{
+    MemArena *mem;
+    MemBlock region;
+    size_t grow_size, decommit_size;
+    // NOTE (Matteo): Segregated free lists, indexed by first and second level size classes
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[MEM_TLSF_FL_COUNT];
+    MemTlsfBlock *blocks[MEM_TLSF_FL_COUNT][MEM_TLSF_SL_COUNT];
+} MemTlsf;
+
+// Initialize the allocator reserving an arena with the given options; since the content of
+// allocations is not cleared, the arena is always created with the "no_zero" flag, and cannot be
+// chained or concurrent. The decommit threshold is also the minimum size of the free spans whose
+// memory is decommitted (256 KB if not set). Returns false if the reservation fails.
+MEM_API bool memTlsfInit(MemTlsf *tlsf, MemArenaInfo const *info);
+
+// Release the arena owned by the allocator
+MEM_API void memTlsfRelease(MemTlsf *tlsf);
+
+// Allocate a block of the given size, aligned to 16 bytes; the content is not cleared.
+// Returns NULL if the arena is exhausted.
+MEM_API void *memTlsfAlloc(MemTlsf *tlsf, size_t size);
+
+// Free a block allocated by memTlsfAlloc or memTlsfRealloc (NULL is ignored)
+MEM_API void memTlsfFree(MemTlsf *tlsf, void *ptr);
+
+// Resize a block, in place if possible, with the same semantics of the C standard realloc
+MEM_API void *memTlsfRealloc(MemTlsf *tlsf, void *ptr, size_t size);
+
+//=== Scratch arenas ===//
+
+// Temporary allocation scope on a thread-local scratch arena
+typedef struct MemScratch
+{
+    MemArena *mem;
+    MemArenaMark mark;
+} MemScratch;
+
+// Get one of the scratch arenas owned by the calling thread, which are reserved lazily on first
+// use. The returned arena is guaranteed not to be one of the given conflicting arenas (typically
+// scratch arenas already in use up the call stack, or the arena the caller is allocating its
+// results from); if no such arena is available the returned arena is NULL.
+MEM_API MemScratch memGetScratch(MemArena *const *conflicts, size_t count);
+
+// Roll back all the allocations performed on the scratch arena since it was obtained
+MEM_API void memReleaseScratch(MemScratch scratch);
+
+// Release all the scratch arenas owned by the calling thread (e.g. before the thread exits)
+MEM_API void memReleaseThreadScratch(void);
+
+//=== Ring buffer ===//
+
+// Byte ring buffer backed by a "magic" double mapping: the same physical pages are mapped twice
+// back to back, so that any span of up to 'cap' bytes starting inside the buffer is contiguous in
+// memory and never needs to be split at the wrap around point.
+// A single producer and a single consumer may operate concurrently without locks; each side
+// publishes its cursor with release semantics and reads the other one with acquire semantics.
+// Zero-initialize and call memRingInit before use.
+typedef struct MemRing
+{
+    uint8_t *ptr;
+    size_t cap;
+    // NOTE (Matteo): Written by the producer only
+    size_t head;
+    // NOTE (Matteo): Keep the cursors on separate cache lines to avoid false sharing
+    uint8_t pad[64];
+    // NOTE (Matteo): Written by the consumer only
+    size_t tail;
+} MemRing;
+
+// Map a ring buffer of at least the given capacity, which is rounded up to the allocation
+// granularity of the system (the page size, or 64 KB on Windows).
+// Supported on Linux (memfd), FreeBSD (anonymous shared memory) and Windows; returns false on
+// other systems or if the mapping fails.
+MEM_API bool memRingInit(MemRing *ring, size_t min_cap);
+
+// Unmap the ring buffer
+MEM_API void memRingRelease(MemRing *ring);
+
+// Producer side: get the contiguous free span, which is written to and then published with
+// memRingEndWrite (not necessarily in full)
+MEM_API MemBlock memRingBeginWrite(MemRing *ring);
+MEM_API void memRingEndWrite(MemRing *ring, size_t len);
+
+// Consumer side: get the contiguous span of published data, which is read and then given back to
+// the producer with memRingEndRead (not necessarily in full)
+MEM_API MemBlock memRingBeginRead(MemRing *ring);
+MEM_API void memRingEndRead(MemRing *ring, size_t len);
+
+//=== Snapshots ===//
+
+// Serialize the memory used by the arena (front end only, and the current block in case of chained
+// arenas) to a relocatable snapshot, allocated from the destination arena.
+// The snapshot records the given fields, expressed as offsets from the start of the arena memory,
+// which must be pointer aligned and hold either NULL or a pointer into the used memory; these are
+// rebased when the snapshot is loaded at a different address.
+// The result is a plain block of memory, meant to be written to a file or sent over the wire as is.
+MEM_API MemBlock memSnapshotWrite(MemArena *mem, size_t const *fields, size_t count,
+                                  MemArena *dst);
+
+// Load a snapshot into an empty arena, with a single copy followed by the pointer fix up pass.
+// The snapshot memory may come from a file mapping and must be aligned to 16 bytes.
+// Alignment of the original allocations is preserved up to 4 KB, so the arena memory must have the
+// same alignment as the original (which is always the case for arenas obtained by memReserve).
+// Returns false if the snapshot is not valid, or does not fit the arena.
+MEM_API bool memSnapshotLoad(MemArena *mem, MemBlock snapshot);
+
 //=== Dynamic buffer utilities ===//
 
 // Parameter bundle for memReallocBufEx, mainly for a compact function declaration and also to take
@@ -178,6 +879,8 @@ typedef struct MemBufInfo
     size_t required_cap;
     uint8_t grow_f;
     bool strict_cap;
+    // Do not guarantee that the grown part of the buffer is cleared to zero
+    bool uninit;
 } MemBufInfo;
 
 // Ensure the buffer is allocated with at least the given capacity
@@ -204,6 +907,18 @@ typedef struct MemBufInfo
                              .curr_buf = buf,              \
                              .curr_cap_ptr = cap_ptr,      \
                              .required_cap = req_cap,      \
+                             .strict_cap = true,           \
+                         })
+
+// Same as memReallocBuf, but the grown part of the buffer is not guaranteed to be cleared to zero
+#define memReallocBufUninit(mem, T, buf, req_cap, cap_ptr) \
+    memReallocBufEx(mem, &(MemBufInfo){                     \
+                             .item_size = sizeof(T),        \
+                             .item_align = MEM_ALIGNOF(T),  \
+                             .curr_buf = buf,               \
+                             .curr_cap_ptr = cap_ptr,       \
+                             .required_cap = req_cap,       \
+                             .uninit = true,                \
                          })
 
 // Try to free the given buffer; since allocations are handed out in a linear fashion,
@@ -235,8 +950,9 @@ MEM_API void *memReallocBufEx(MemArena *mem, MemBufInfo const *info);
 #define MEM_STR(x) MEM_STR_INNER(x)
 #define MEM_STR_INNER(x) #x
 
+#if defined(_WIN32)
+
 // Windows
-// TODO (Matteo): Support other platforms
 #if !defined(NOMINMAX)
 #define NOMINMAX 1
 #endif
@@ -260,6 +976,47 @@ MEM_API void *memReallocBufEx(MemArena *mem, MemBufInfo const *info);
 #pragma warning(pop)
 #endif
 
+#else
+
+// POSIX
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(MEM_ENABLE_PERF)
+#include <linux/perf_event.h>
+#endif
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define MEM_HAS_BACKTRACE 1
+#endif
+
+#if !defined(MAP_ANONYMOUS)
+#if defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#else
+#error "Anonymous mappings not available: define _DEFAULT_SOURCE before including system headers"
+#endif
+#endif
+
+#if !defined(MAP_NORESERVE)
+#define MAP_NORESERVE 0
+#endif
+
+#if !defined(MAP_FIXED_NOREPLACE)
+#define MAP_FIXED_NOREPLACE 0
+#endif
+
+#endif
+
 // Assertions
 #if !defined(MEM_ASSERT)
 #include <assert.h>
@@ -272,17 +1029,75 @@ MEM_API void *memReallocBufEx(MemArena *mem, MemBufInfo const *info);
 #elif MEM_HAS_BUILTIN(__builtin_memset)
 #define MEM_SET __builtin_memset
 #define MEM_ZERO(ptr, len) MEM_SET(ptr, 0, len)
-#else
+#elif defined(_WIN32)
 #define MEM_SET(ptr, val, len) FillMemory(ptr, len, val)
 #define MEM_ZERO ZeroMemory
+#else
+#include <string.h>
+#define MEM_SET memset
+#define MEM_ZERO(ptr, len) MEM_SET(ptr, 0, len)
 #endif
 
 // MEM_COPY: memcpy
 #if !defined(MEM_COPY)
 #if MEM_HAS_BUILTIN(__builtin_memcpy)
 #define MEM_COPY __builtin_memcpy
-#else
+#elif defined(_WIN32)
 #define MEM_COPY CopyMemory
+#else
+#include <string.h>
+#define MEM_COPY memcpy
+#endif
+#endif
+
+// Atomics
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Trace and profile export
+#include <stdio.h>
+
+// USDT probes, with provider 'mem':
+//      reserve(MemArena *mem, size_t size)
+//      release(MemArena *mem)
+//      alloc(MemArena *mem, void *ptr, size_t len, size_t alignment)
+//      alloc_fail(MemArena *mem, size_t len, size_t alignment)
+//      resize(MemArena *mem, void *ptr, size_t new_len, int success)
+//      clear(MemArena *mem)
+//      commit_begin/commit_end(MemArena *mem, void *ptr, size_t len)
+//      decommit_begin/decommit_end(MemArena *mem, void *ptr, size_t len)
+#if defined(MEM_ENABLE_USDT)
+#include <sys/sdt.h>
+#define MEM_PROBE1(name, a) DTRACE_PROBE1(mem, name, a)
+#define MEM_PROBE2(name, a, b) DTRACE_PROBE2(mem, name, a, b)
+#define MEM_PROBE3(name, a, b, c) DTRACE_PROBE3(mem, name, a, b, c)
+#define MEM_PROBE4(name, a, b, c, d) DTRACE_PROBE4(mem, name, a, b, c, d)
+#else
+// NOTE (Matteo): Arguments are not evaluated, but still count as used
+#define MEM_PROBE1(name, a) ((void)sizeof(a))
+#define MEM_PROBE2(name, a, b) (MEM_PROBE1(name, a), (void)sizeof(b))
+#define MEM_PROBE3(name, a, b, c) (MEM_PROBE2(name, a, b), (void)sizeof(c))
+#define MEM_PROBE4(name, a, b, c, d) (MEM_PROBE3(name, a, b, c), (void)sizeof(d))
+#endif
+
+// MEM_THREAD_LOCAL
+#if defined(_MSC_VER)
+#define MEM_THREAD_LOCAL __declspec(thread)
+#else
+#define MEM_THREAD_LOCAL _Thread_local
+#endif
+
+// Scratch arenas
+#if !defined(MEM_SCRATCH_COUNT)
+#define MEM_SCRATCH_COUNT 2
+#endif
+
+#if !defined(MEM_SCRATCH_SIZE)
+#if UINTPTR_MAX > 0xFFFFFFFF
+#define MEM_SCRATCH_SIZE MEM_GB(8)
+#else
+#define MEM_SCRATCH_SIZE MEM_MB(64)
 #endif
 #endif
 
@@ -291,23 +1106,85 @@ MEM_API void *memReallocBufEx(MemArena *mem, MemBufInfo const *info);
 enum
 {
     // Misc
-    MEM_PAGE_SIZE = 4096,
+    // NOTE (Matteo): The actual page size is queried at runtime (it can be 16K or 64K on some
+    // systems); this is just the lower bound used for compile time checks
+    MEM_MIN_PAGE_SIZE = 4096,
 
     // Option flags
     MEM_FLAG_UNSAFE = 0x02,
+    MEM_FLAG_NO_ZERO = 0x04,
+    MEM_FLAG_CONCURRENT = 0x08,
+    MEM_FLAG_CHAINED = 0x10,
+    MEM_FLAG_CHAIN_RETAIN = 0x20,
+    MEM_FLAG_PERSISTENT = 0x40,
+    MEM_FLAG_SHARED = 0x80,
+    MEM_FLAG_CLONEABLE = 0x100,
+    MEM_FLAG_CLONE = 0x200,
+
+    // Signature of the data structure of persistent arenas, to be bumped on layout changes
+    MEM_PERSIST_MAGIC = 0x4D454D03,
 };
 
 struct MemArena
 {
+    // NOTE (Matteo): Must match MemArenaHead
     uint8_t *ptr;
-    size_t len, cap, commit;
+    size_t len, fast_cap;
+
+    size_t cap, commit;
+    size_t page_size, reserved;
+    size_t commit_size, decommit_threshold;
+    // NOTE (Matteo): Upper bound of the released memory that may be dirty, only tracked for
+    // MEM_FLAG_NO_ZERO and for blocks shrunk in concurrent arenas; memory past the current length
+    // is clear if this is not greater.
+    size_t dirty;
+    // NOTE (Matteo): Held by the thread committing memory, only used for MEM_FLAG_CONCURRENT
+    size_t commit_lock;
+    // NOTE (Matteo): Arena this one was forked from, if any
+    MemArena *parent;
+    // NOTE (Matteo): Chained arenas only: header of the current block (which stores the state of
+    // the previous one), size of the previous blocks, list of retained blocks and growth factor
+    MemArena *prev;
+    size_t base_pos;
+    MemArena *spare;
+    uint8_t chain_grow_f;
+    // NOTE (Matteo): Memory used and committed from the back end (the latter is page aligned)
+    size_t back_len, back_commit;
     uint32_t flags;
+    // NOTE (Matteo): Persistent arenas only, see MEM_PERSIST_MAGIC
+    uint32_t magic;
+    // NOTE (Matteo): Cloneable arenas only, file backing the memory
+    int fd;
+    MemTrace *trace;
+    // NOTE (Matteo): Profiled arenas only: end of the live samples at the front end (plus 1) and at
+    // the back end, so that the profiler is notified only when they are released
+    MemProfile *profile;
+    size_t profile_top, profile_back_top;
+    // NOTE (Matteo): Registered arenas only: links of the registry list (which is not circular),
+    // name and tag
+    MemArena *registry_prev, *registry_next;
+    char name[MEM_ARENA_NAME_LEN];
+    uint32_t tag;
+#if defined(MEM_ENABLE_STATS)
+    // NOTE (Matteo): Must be last, so that the layout of persistent arenas does not depend on it
+    MemArenaStats stats;
+#endif
+#if defined(MEM_ENABLE_PERF)
+    // NOTE (Matteo): Must be last, like the statistics; memory below the touched mark is known to
+    // have been written since it was committed
+    MemPerfCounters perf[MEM_PERF_OP_COUNT];
+    size_t perf_touched;
+#endif
 };
 
 //=== Type checks ===//
 
-_Static_assert(sizeof(MemArena) <= MEM_PAGE_SIZE, "Allocator does not fit page size");
+_Static_assert(sizeof(MemArena) <= MEM_MIN_PAGE_SIZE, "Allocator does not fit page size");
 _Static_assert(sizeof(size_t) == sizeof(uintptr_t), "Pointer size mismatch");
+_Static_assert(offsetof(MemArena, ptr) == offsetof(MemArenaHead, ptr), "Arena head mismatch");
+_Static_assert(offsetof(MemArena, len) == offsetof(MemArenaHead, len), "Arena head mismatch");
+_Static_assert(offsetof(MemArena, fast_cap) == offsetof(MemArenaHead, fast_cap),
+               "Arena head mismatch");
 _Static_assert(MEM_ALIGNOF(size_t) == MEM_ALIGNOF(uintptr_t), "Pointer alignment mismatch");
 
 //=== Internal utilities ===//
@@ -338,249 +1215,3657 @@ alignForward(size_t address, size_t alignment)
     return alignBackward(address + (alignment - 1), alignment);
 }
 
-static inline bool
-lastAlloc(MemArena *mem, MemBlock const *block)
+// Index of the most significant bit set (value must not be 0)
+static inline uint32_t
+highBit(size_t value)
 {
-    if (!block || !block->ptr) return false;
+    MEM_ASSERT(value);
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+#if defined(_WIN64)
+    _BitScanReverse64(&index, value);
+#else
+    _BitScanReverse(&index, value);
+#endif
+    return (uint32_t)index;
+#else
+    return (uint32_t)(sizeof(unsigned long long) * 8 - 1) - (uint32_t)__builtin_clzll(value);
+#endif
+}
 
-    uint8_t *mem_end = mem->ptr + mem->len;
-    uint8_t *block_end = block->ptr + block->len;
-    return (mem_end == block_end);
+// Index of the least significant bit set (value must not be 0)
+static inline uint32_t
+lowBit(uint32_t value)
+{
+    MEM_ASSERT(value);
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(value);
+#endif
 }
 
-static inline void
-commit(MemBlock block)
+// NOTE (Matteo): Atomic operations are implemented with compiler intrinsics because support for
+// <stdatomic.h> is still spotty (e.g. MSVC); they operate on plain size_t fields so that the
+// arena layout does not depend on the concurrency mode
+
+static inline size_t
+atomicLoad(size_t *ptr)
 {
-    void *result = VirtualAlloc(block.ptr, block.len, MEM_COMMIT, PAGE_READWRITE);
-    MEM_ASSERT(result);
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_WIN64)
+    return (size_t)_InterlockedOr64((__int64 volatile *)ptr, 0);
+#else
+    return (size_t)_InterlockedOr((long volatile *)ptr, 0);
+#endif
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
 }
 
 static inline void
-decommit(MemBlock block)
+atomicStore(size_t *ptr, size_t value)
 {
-    // NOTE (Matteo): Avoid syscalls for no-ops
-    if (block.len)
-    {
-#if defined(_MSC_VER)
-#pragma warning(suppress : 6250)
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_WIN64)
+    _InterlockedExchange64((__int64 volatile *)ptr, (__int64)value);
+#else
+    _InterlockedExchange((long volatile *)ptr, (long)value);
+#endif
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
 #endif
-        // NOTE (Matteo): This warns about using MEM_RELEASE without MEM_DECOMMIT, which is exactly
-        // what we want
-        BOOL result = VirtualFree(block.ptr, block.len, MEM_DECOMMIT);
-        MEM_ASSERT(result);
-    }
 }
 
+// Orders the preceding loads before any subsequent load or store
 static inline void
-adjustCommited(MemArena *mem)
+atomicFenceAcquire(void)
 {
-    size_t min_commit = alignForward(mem->len, MEM_PAGE_SIZE);
-
-    if (min_commit < mem->commit)
+#if defined(_MSC_VER) && !defined(__clang__)
+    MemoryBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+// Orders the preceding loads and stores before any subsequent store
+static inline void
+atomicFenceRelease(void)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    MemoryBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+}
+
+// Compare-and-swap; on failure the current value is stored in 'expected'
+static inline bool
+atomicCas(size_t *ptr, size_t *expected, size_t desired)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    size_t prev = *expected;
+#if defined(_WIN64)
+    *expected = (size_t)_InterlockedCompareExchange64((__int64 volatile *)ptr, (__int64)desired,
+                                                      (__int64)prev);
+#else
+    *expected =
+        (size_t)_InterlockedCompareExchange((long volatile *)ptr, (long)desired, (long)prev);
+#endif
+    return *expected == prev;
+#else
+    return __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Returns the previous value
+static inline size_t
+atomicAdd(size_t *ptr, size_t value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_WIN64)
+    return (size_t)_InterlockedExchangeAdd64((__int64 volatile *)ptr, (__int64)value);
+#else
+    return (size_t)_InterlockedExchangeAdd((long volatile *)ptr, (long)value);
+#endif
+#else
+    return __atomic_fetch_add(ptr, value, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void
+atomicMax(size_t *ptr, size_t value)
+{
+    size_t curr = atomicLoad(ptr);
+    while (curr < value && !atomicCas(ptr, &curr, value))
+    {
+    }
+}
+
+static inline bool
+lastAlloc(MemArena *mem, MemBlock const *block)
+{
+    if (!block || !block->ptr) return false;
+
+    uint8_t *mem_end = mem->ptr + mem->len;
+    uint8_t *block_end = block->ptr + block->len;
+    return (mem_end == block_end);
+}
+
+//=== Platform layer ===//
+
+#if defined(_WIN32)
+
+static inline size_t
+pageSize(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+}
+
+static inline void *
+reserve(size_t size)
+{
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+static inline void
+yieldThread(void)
+{
+    SwitchToThread();
+}
+
+// Monotonic time in nanoseconds
+static inline uint64_t
+timeNs(void)
+{
+    LARGE_INTEGER counter, freq;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&freq);
+    uint64_t ticks = (uint64_t)counter.QuadPart;
+    uint64_t rate = (uint64_t)freq.QuadPart;
+    return (ticks / rate) * 1000000000 + (ticks % rate) * 1000000000 / rate;
+}
+
+static inline void
+release(MemBlock block)
+{
+    BOOL result = VirtualFree(block.ptr, 0, MEM_RELEASE);
+    MEM_ASSERT(result);
+    (void)result;
+}
+
+static inline void
+commit(MemBlock block)
+{
+    // NOTE (Matteo): Avoid syscalls for no-ops
+    if (!block.len) return;
+
+    void *result = VirtualAlloc(block.ptr, block.len, MEM_COMMIT, PAGE_READWRITE);
+    MEM_ASSERT(result);
+    (void)result;
+}
+
+static inline void
+decommit(MemBlock block)
+{
+    // NOTE (Matteo): Avoid syscalls for no-ops
+    if (block.len)
+    {
+#if defined(_MSC_VER)
+#pragma warning(suppress : 6250)
+#endif
+        // NOTE (Matteo): This warns about using MEM_RELEASE without MEM_DECOMMIT, which is exactly
+        // what we want
+        BOOL result = VirtualFree(block.ptr, block.len, MEM_DECOMMIT);
+        MEM_ASSERT(result);
+        (void)result;
+    }
+}
+
+// NOTE (Matteo): Persistent and shared arenas are not supported, so these are just stubs
+
+static inline uint8_t *
+mapFile(char const *path, void *address, size_t *size, bool shared, bool *created)
+{
+    (void)path;
+    (void)address;
+    (void)size;
+    (void)shared;
+    (void)created;
+    return NULL;
+}
+
+static inline void *
+reserveShared(size_t size)
+{
+    (void)size;
+    return NULL;
+}
+
+static inline void
+discard(MemBlock block, bool shared)
+{
+    (void)shared;
+    decommit(block);
+}
+
+static inline bool
+syncFile(MemBlock block)
+{
+    (void)block;
+    return false;
+}
+
+static inline size_t
+ringGranularity(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+static uint8_t *
+mapRing(size_t cap)
+{
+    ULARGE_INTEGER size = {.QuadPart = cap};
+    HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, size.HighPart,
+                                        size.LowPart, NULL);
+    if (!section) return NULL;
+
+    uint8_t *result = NULL;
+
+    // NOTE (Matteo): The address range found by the reservation must be released before mapping
+    // the views on it, so another thread may steal it in the meantime; just retry a few times.
+    for (int attempt = 0; attempt < 16 && !result; ++attempt)
+    {
+        uint8_t *base = VirtualAlloc(NULL, 2 * cap, MEM_RESERVE, PAGE_NOACCESS);
+        if (!base) break;
+        VirtualFree(base, 0, MEM_RELEASE);
+
+        void *lo = MapViewOfFileEx(section, FILE_MAP_ALL_ACCESS, 0, 0, cap, base);
+        void *hi = lo ? MapViewOfFileEx(section, FILE_MAP_ALL_ACCESS, 0, 0, cap, base + cap) : NULL;
+
+        if (hi)
+        {
+            result = base;
+        }
+        else if (lo)
+        {
+            UnmapViewOfFile(lo);
+        }
+    }
+
+    // NOTE (Matteo): The views keep the section alive
+    CloseHandle(section);
+
+    return result;
+}
+
+static inline void
+unmapRing(uint8_t *ptr, size_t cap)
+{
+    BOOL result = UnmapViewOfFile(ptr + cap);
+    MEM_ASSERT(result);
+    result = UnmapViewOfFile(ptr);
+    MEM_ASSERT(result);
+    (void)result;
+}
+
+// NOTE (Matteo): Cloning is not supported, so these are just stubs
+
+static inline void *
+reserveFile(size_t size, int *fd)
+{
+    (void)size;
+    *fd = -1;
+    return NULL;
+}
+
+static inline uint8_t *
+mapClone(int fd, size_t size, size_t offset)
+{
+    (void)fd;
+    (void)size;
+    (void)offset;
+    return NULL;
+}
+
+static inline void
+remap(MemBlock block)
+{
+    decommit(block);
+}
+
+static inline void
+closeFile(int fd)
+{
+    (void)fd;
+}
+
+// Capture the return addresses of the calling thread, innermost first
+static inline uint32_t
+captureStack(void **frames, uint32_t max_depth)
+{
+    return RtlCaptureStackBackTrace(0, max_depth, frames, NULL);
+}
+
+// Memory map of the process in the format of /proc/self/maps, or -1 if not available
+static inline int
+openMaps(void)
+{
+    return -1;
+}
+
+static inline ptrdiff_t
+readFile(int fd, void *buf, size_t len)
+{
+    (void)fd;
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+// Open the performance counters of the calling thread, storing their descriptors in the order of
+// MEM_PERF_PAGE_FAULTS etc. (-1 if not available); returns the available counters
+static inline uint32_t
+perfOpen(int *fds)
+{
+    for (uint32_t i = 0; i < 3; ++i) fds[i] = -1;
+    return 0;
+}
+
+// Read the counters opened by perfOpen, in the same order (0 if not available)
+static inline void
+perfRead(int const *fds, uint32_t available, uint64_t *values)
+{
+    (void)fds;
+    (void)available;
+    for (uint32_t i = 0; i < 3; ++i) values[i] = 0;
+}
+
+static inline void
+perfClose(int const *fds)
+{
+    (void)fds;
+}
+
+#else
+
+static inline size_t
+pageSize(void)
+{
+    long result = sysconf(_SC_PAGESIZE);
+    MEM_ASSERT(result > 0);
+    return (size_t)result;
+}
+
+static inline void *
+reserve(size_t size)
+{
+    // NOTE (Matteo): Reserved memory is mapped without access rights, so that it does not count
+    // against the commit charge until explicitly committed via mprotect
+    void *result =
+        mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return result == MAP_FAILED ? NULL : result;
+}
+
+static inline void
+yieldThread(void)
+{
+    sched_yield();
+}
+
+// Monotonic time in nanoseconds
+static inline uint64_t
+timeNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static inline void
+release(MemBlock block)
+{
+    int result = munmap(block.ptr, block.len);
+    MEM_ASSERT(result == 0);
+    (void)result;
+}
+
+// Replace the given range with a fresh reserved mapping
+static inline void
+remap(MemBlock block)
+{
+    void *result = mmap(block.ptr, block.len, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    MEM_ASSERT(result == block.ptr);
+    (void)result;
+}
+
+static inline void
+commit(MemBlock block)
+{
+    // NOTE (Matteo): Avoid syscalls for no-ops
+    if (!block.len) return;
+
+    int result = mprotect(block.ptr, block.len, PROT_READ | PROT_WRITE);
+    MEM_ASSERT(result == 0);
+    (void)result;
+}
+
+static inline void
+decommit(MemBlock block)
+{
+    // NOTE (Matteo): Avoid syscalls for no-ops
+    if (block.len)
+    {
+#if defined(__linux__)
+        // NOTE (Matteo): MADV_DONTNEED on private anonymous mappings drops the physical pages and
+        // guarantees zero-filled pages on the next commit
+        int result = madvise(block.ptr, block.len, MADV_DONTNEED);
+        MEM_ASSERT(result == 0);
+        result = mprotect(block.ptr, block.len, PROT_NONE);
+        MEM_ASSERT(result == 0);
+        (void)result;
+#else
+        // NOTE (Matteo): Other systems do not guarantee zero-filled pages after MADV_DONTNEED, so
+        // the range is replaced with a fresh reserved mapping instead
+        remap(block);
+#endif
+    }
+}
+
+// Map the given file at a fixed address, without access rights unless shared; an empty file is
+// resized to the given size (and reported as created), otherwise the actual size is returned
+static uint8_t *
+mapFile(char const *path, void *address, size_t *size, bool shared, bool *created)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return NULL;
+
+    uint8_t *result = NULL;
+    struct stat info;
+
+    if (fstat(fd, &info) == 0)
+    {
+        *created = (info.st_size == 0);
+
+        if (!*created)
+        {
+            *size = (size_t)info.st_size;
+        }
+        else if (ftruncate(fd, (off_t)*size) != 0)
+        {
+            close(fd);
+            return NULL;
+        }
+
+        // NOTE (Matteo): Without MAP_FIXED_NOREPLACE the address is just a hint, which is fine as
+        // long as the result is checked
+        int prot = shared ? PROT_READ | PROT_WRITE : PROT_NONE;
+        void *ptr = mmap(address, *size, prot, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+        if (ptr == address)
+        {
+            result = ptr;
+        }
+        else
+        {
+            if (ptr != MAP_FAILED) munmap(ptr, *size);
+
+            // NOTE (Matteo): Leave the file empty, so that it is initialized on the next attempt
+            if (*created)
+            {
+                int truncated = ftruncate(fd, 0);
+                (void)truncated;
+            }
+        }
+    }
+
+    // NOTE (Matteo): The mapping keeps the file alive
+    close(fd);
+
+    return result;
+}
+
+// NOTE (Matteo): Shared memory is accessible in full from the start, because changes of protection
+// would affect the calling process only
+
+static inline void *
+reserveShared(size_t size)
+{
+    void *result = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return result == MAP_FAILED ? NULL : result;
+}
+
+// Decommit memory mapped from a file (or shared), discarding its content; shared memory is kept
+// accessible
+static inline void
+discard(MemBlock block, bool shared)
+{
+    if (!block.len) return;
+
+    // NOTE (Matteo): Dropping the pages is not enough, since they would be read back from the file
+    // on the next access: punch a hole in the file if supported, otherwise clear the memory
+#if defined(MADV_REMOVE)
+    if (madvise(block.ptr, block.len, MADV_REMOVE) != 0)
+#endif
+    {
+        MEM_ZERO(block.ptr, block.len);
+    }
+
+    if (!shared)
+    {
+        int result = mprotect(block.ptr, block.len, PROT_NONE);
+        MEM_ASSERT(result == 0);
+        (void)result;
+    }
+}
+
+static inline bool
+syncFile(MemBlock block)
+{
+    return msync(block.ptr, block.len, MS_SYNC) == 0;
+}
+
+static inline size_t
+ringGranularity(void)
+{
+    return pageSize();
+}
+
+// Anonymous shared memory file, or -1 if not supported
+static inline int
+anonFile(void)
+{
+#if defined(__linux__) && defined(SYS_memfd_create)
+    // NOTE (Matteo): The memfd_create wrapper is only declared with _GNU_SOURCE (and by recent
+    // versions of glibc), so the syscall is invoked directly; 1 is MFD_CLOEXEC
+    return (int)syscall(SYS_memfd_create, "mem", 1u);
+#elif defined(SHM_ANON)
+    return shm_open(SHM_ANON, O_RDWR | O_CLOEXEC, 0600);
+#else
+    return -1;
+#endif
+}
+
+static uint8_t *
+mapRing(size_t cap)
+{
+    int fd = anonFile();
+    if (fd < 0) return NULL;
+
+    uint8_t *result = NULL;
+
+    if (ftruncate(fd, (off_t)cap) == 0)
+    {
+        // NOTE (Matteo): Reserve the whole range first, then replace both halves with the views
+        result = reserve(2 * cap);
+        if (result)
+        {
+            int prot = PROT_READ | PROT_WRITE;
+            void *lo = mmap(result, cap, prot, MAP_SHARED | MAP_FIXED, fd, 0);
+            void *hi = mmap(result + cap, cap, prot, MAP_SHARED | MAP_FIXED, fd, 0);
+            if (lo == MAP_FAILED || hi == MAP_FAILED)
+            {
+                release((MemBlock){.ptr = result, .len = 2 * cap});
+                result = NULL;
+            }
+        }
+    }
+
+    // NOTE (Matteo): The mappings keep the file alive
+    close(fd);
+
+    return result;
+}
+
+static inline void
+unmapRing(uint8_t *ptr, size_t cap)
+{
+    release((MemBlock){.ptr = ptr, .len = 2 * cap});
+}
+
+// Reserve memory backed by an anonymous file, which is returned for cloning
+static void *
+reserveFile(size_t size, int *fd)
+{
+    *fd = anonFile();
+    if (*fd < 0) return NULL;
+
+    void *result = MAP_FAILED;
+    if (ftruncate(*fd, (off_t)size) == 0)
+    {
+        result = mmap(NULL, size, PROT_NONE, MAP_SHARED | MAP_NORESERVE, *fd, 0);
+    }
+
+    if (result == MAP_FAILED)
+    {
+        close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+
+    return result;
+}
+
+// Reserve memory and map the given file privately (i.e. copy-on-write) from the given offset on
+static uint8_t *
+mapClone(int fd, size_t size, size_t offset)
+{
+    uint8_t *result = reserve(size);
+    if (!result) return NULL;
+
+    void *view = mmap(result + offset, size - offset, PROT_NONE,
+                      MAP_PRIVATE | MAP_NORESERVE | MAP_FIXED, fd, (off_t)offset);
+    if (view == MAP_FAILED)
+    {
+        release((MemBlock){.ptr = result, .len = size});
+        return NULL;
+    }
+
+    return result;
+}
+
+static inline void
+closeFile(int fd)
+{
+    close(fd);
+}
+
+// Capture the return addresses of the calling thread, innermost first
+static inline uint32_t
+captureStack(void **frames, uint32_t max_depth)
+{
+#if defined(MEM_HAS_BACKTRACE)
+    int depth = backtrace(frames, (int)max_depth);
+    return depth > 0 ? (uint32_t)depth : 0;
+#else
+    (void)frames;
+    (void)max_depth;
+    return 0;
+#endif
+}
+
+// Memory map of the process in the format of /proc/self/maps, or -1 if not available
+static inline int
+openMaps(void)
+{
+    return open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+}
+
+static inline ptrdiff_t
+readFile(int fd, void *buf, size_t len)
+{
+    return read(fd, buf, len);
+}
+
+#if defined(__linux__) && defined(MEM_ENABLE_PERF) && defined(SYS_perf_event_open)
+#define MEM_HAS_PERF_EVENTS 1
+#endif
+
+// Open the performance counters of the calling thread, storing their descriptors in the order of
+// MEM_PERF_PAGE_FAULTS etc. (-1 if not available); returns the available counters
+static inline uint32_t
+perfOpen(int *fds)
+{
+    uint32_t available = 0;
+    for (uint32_t i = 0; i < 3; ++i) fds[i] = -1;
+
+#if defined(MEM_HAS_PERF_EVENTS)
+    static struct
+    {
+        uint32_t type;
+        uint64_t config;
+    } const events[3] = {
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    };
+
+    // NOTE (Matteo): The counters are read at once as a group. Page faults are handled by the
+    // kernel, which is included unless denied by perf_event_paranoid.
+    int leader = -1;
+
+    for (int user_only = 0; user_only < 2 && leader < 0; ++user_only)
+    {
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            struct perf_event_attr attr = {
+                .size = sizeof(attr),
+                .type = events[i].type,
+                .config = events[i].config,
+                .read_format = PERF_FORMAT_GROUP,
+                .exclude_kernel = user_only,
+                .exclude_hv = 1,
+            };
+
+            fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+            if (fds[i] < 0) continue;
+
+            available |= 1u << i;
+            if (leader < 0) leader = fds[i];
+        }
+    }
+#endif
+
+    return available;
+}
+
+// Read the counters opened by perfOpen, in the same order (0 if not available)
+static inline void
+perfRead(int const *fds, uint32_t available, uint64_t *values)
+{
+    for (uint32_t i = 0; i < 3; ++i) values[i] = 0;
+
+    // NOTE (Matteo): The first counter available is the leader of the group
+    uint32_t leader = 0;
+    while (leader < 3 && fds[leader] < 0) ++leader;
+    if (leader == 3) return;
+
+    struct
+    {
+        uint64_t count;
+        uint64_t values[3];
+    } group = {0};
+
+    if (read(fds[leader], &group, sizeof(group)) <= 0) return;
+
+    for (uint32_t i = 0, index = 0; i < 3 && index < group.count; ++i)
+    {
+        if (available & (1u << i)) values[i] = group.values[index++];
+    }
+}
+
+static inline void
+perfClose(int const *fds)
+{
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+}
+
+#endif
+
+static inline size_t
+commitTarget(MemArena *mem, size_t len)
+{
+    // NOTE (Matteo): Commit boundaries are aligned in absolute terms, since the arena memory is
+    // not page aligned in case of forked arenas (which share the first page with their header).
+    // Commit operations cannot exceed the reserved block.
+    size_t base = (size_t)mem->ptr;
+    size_t max_commit = alignForward(base + mem->cap, mem->page_size) - base;
+    size_t target = alignForward(base + len, mem->commit_size) - base;
+    return target < max_commit ? target : max_commit;
+}
+
+// End of the memory available to the back end, as offset from the arena memory (page aligned)
+static inline size_t
+backEnd(MemArena *mem)
+{
+    size_t base = (size_t)mem->ptr;
+    return alignForward(base + mem->cap, mem->page_size) - base;
+}
+
+// Size of the committed memory, counting once the pages shared by the two ends
+static inline size_t
+commitLen(MemArena *mem)
+{
+    size_t commit = atomicLoad(&mem->commit);
+    if (!mem->back_commit) return commit;
+
+    size_t back_end = backEnd(mem);
+    size_t back_start = back_end - mem->back_commit;
+    if (commit < back_start) return commit + mem->back_commit;
+    return commit > back_end ? commit : back_end;
+}
+
+// NOTE (Matteo): Statistics are updated atomically, for the benefit of concurrent arenas; the
+// helpers compile to nothing if statistics are disabled
+#if defined(MEM_ENABLE_STATS)
+#define MEM_STAT_ADD(mem, field, value) (void)atomicAdd(&(mem)->stats.field, (value))
+#else
+#define MEM_STAT_ADD(mem, field, value) ((void)(mem))
+#endif
+
+static inline void
+statsUpdatePeak(MemArena *mem)
+{
+#if defined(MEM_ENABLE_STATS)
+    atomicMax(&mem->stats.peak_len, mem->base_pos + atomicLoad(&mem->len));
+    atomicMax(&mem->stats.peak_commit, commitLen(mem));
+#else
+    (void)mem;
+#endif
+}
+
+// NOTE (Matteo): Performance counters are opened lazily by each thread; the helpers compile to
+// nothing if they are disabled
+#if defined(MEM_ENABLE_PERF)
+static MEM_THREAD_LOCAL int g_perf_fds[3];
+static MEM_THREAD_LOCAL uint32_t g_perf_available;
+static MEM_THREAD_LOCAL bool g_perf_open;
+#endif
+
+typedef struct PerfSample
+{
+    uint64_t time;
+    uint64_t values[3];
+} PerfSample;
+
+static inline PerfSample
+perfBegin(void)
+{
+    PerfSample sample = {0};
+
+#if defined(MEM_ENABLE_PERF)
+    if (!g_perf_open)
+    {
+        g_perf_available = perfOpen(g_perf_fds);
+        g_perf_open = true;
+    }
+
+    perfRead(g_perf_fds, g_perf_available, sample.values);
+    sample.time = timeNs();
+#endif
+
+    return sample;
+}
+
+static inline void
+perfEnd(MemArena *mem, MemPerfOp op, PerfSample const *begin)
+{
+#if defined(MEM_ENABLE_PERF)
+    PerfSample end = {.time = timeNs()};
+    perfRead(g_perf_fds, g_perf_available, end.values);
+
+    MemPerfCounters *counters = mem->perf + op;
+    atomicAdd(&counters->count, 1);
+    atomicAdd(&counters->time_ns, (size_t)(end.time - begin->time));
+    atomicAdd(&counters->page_faults, (size_t)(end.values[0] - begin->values[0]));
+    atomicAdd(&counters->dtlb_misses, (size_t)(end.values[1] - begin->values[1]));
+    atomicAdd(&counters->cycles, (size_t)(end.values[2] - begin->values[2]));
+#else
+    (void)mem;
+    (void)op;
+    (void)begin;
+#endif
+}
+
+// Clear the given memory of the arena to zero
+static inline void
+zeroArena(MemArena *mem, uint8_t *ptr, size_t len)
+{
+    PerfSample begin = perfBegin();
+    MEM_ZERO(ptr, len);
+    perfEnd(mem, MEM_PERF_ZERO, &begin);
+}
+
+// Write the pages of the arena memory that were not touched since they were committed, up to the
+// given offset, in order to measure the page faults
+static inline void
+touchArena(MemArena *mem, size_t end)
+{
+#if defined(MEM_ENABLE_PERF)
+    if (end <= mem->perf_touched) return;
+
+    PerfSample begin = perfBegin();
+
+    // NOTE (Matteo): An atomic no-op preserves the content, and does not race with other writers
+    for (uint8_t *ptr = mem->ptr + mem->perf_touched; ptr < mem->ptr + end;
+         ptr = (uint8_t *)alignForward((size_t)ptr + 1, mem->page_size))
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        _InterlockedOr8((char volatile *)ptr, 0);
+#else
+        __atomic_fetch_or(ptr, 0, __ATOMIC_RELAXED);
+#endif
+    }
+
+    perfEnd(mem, MEM_PERF_FIRST_TOUCH, &begin);
+
+    // NOTE (Matteo): The last page has been touched as a whole
+    size_t base = (size_t)mem->ptr;
+    mem->perf_touched = alignForward(base + end, mem->page_size) - base;
+#else
+    (void)mem;
+    (void)end;
+#endif
+}
+
+// NOTE (Matteo): Timestamps are taken only while recording
+static inline uint64_t
+traceBegin(MemArena *mem)
+{
+    return mem->trace ? timeNs() : 0;
+}
+
+static void
+traceRecord(MemTrace *trace, MemTraceKind kind, uint64_t start, ptrdiff_t offset, size_t size,
+            size_t alignment)
+{
+    uint64_t now = timeNs();
+    size_t seq = atomicAdd(&trace->next, 1);
+    MemTraceEvent *event = trace->events + (seq & (trace->cap - 1));
+
+    // NOTE (Matteo): The sequence number guards against torn reads by the exporter; the fence
+    // keeps the writes of the fields after its reset
+    atomicStore(&event->seq, 0);
+    atomicFenceRelease();
+    event->time = start ? start : now;
+    event->duration = start ? now - start : 0;
+    event->offset = offset;
+    event->size = size;
+    event->alignment = alignment;
+    event->kind = kind;
+    atomicStore(&event->seq, seq + 1);
+}
+
+static inline void
+traceEvent(MemArena *mem, MemTraceKind kind, uint64_t start, uint8_t const *ptr, size_t size,
+           size_t alignment)
+{
+    if (mem->trace) traceRecord(mem->trace, kind, start, ptr - mem->ptr, size, alignment);
+}
+
+// NOTE (Matteo): Locks for infrequent operations, which yield to other threads while waiting
+static inline void
+spinLock(size_t *lock)
+{
+    size_t unlocked = 0;
+    while (!atomicCas(lock, &unlocked, 1))
+    {
+        unlocked = 0;
+        yieldThread();
+    }
+}
+
+static inline void
+spinUnlock(size_t *lock)
+{
+    atomicStore(lock, 0);
+}
+
+// NOTE (Matteo): Heap profiling is driven by a per-thread countdown of the allocated bytes, with
+// random intervals averaging the sampling period, so that periodic allocation patterns do not
+// always hit the same call site; 0 means that the countdown has not started yet
+static MEM_THREAD_LOCAL size_t g_profile_left;
+static MEM_THREAD_LOCAL uint64_t g_profile_rng;
+
+// Random sampling interval, uniform in [1, 2 * period]
+static inline size_t
+profileInterval(size_t period)
+{
+    // NOTE (Matteo): xorshift64, seeded lazily for each thread
+    uint64_t x = g_profile_rng ? g_profile_rng : (timeNs() | 1);
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    g_profile_rng = x;
+    return 1 + (size_t)(x & (2 * period - 1));
+}
+
+// Find or insert the site with the given call stack; returns site_cap if the table is full
+static size_t
+profileSite(MemProfile *profile, void *const *frames, uint32_t depth)
+{
+    // NOTE (Matteo): FNV-1a over the return addresses
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (uint32_t i = 0; i < depth; ++i)
+    {
+        hash = (hash ^ (uint64_t)(size_t)frames[i]) * 0x100000001B3ull;
+    }
+
+    size_t mask = profile->site_cap - 1;
+
+    for (size_t index = (size_t)hash & mask;; index = (index + 1) & mask)
+    {
+        MemProfileSite *site = profile->sites + index;
+
+        // NOTE (Matteo): Sites in use have been sampled at least once
+        if (!site->total_bytes)
+        {
+            // NOTE (Matteo): The table is kept at most half full, for short probe sequences
+            if (2 * (profile->site_len + 1) > profile->site_cap) return profile->site_cap;
+
+            ++profile->site_len;
+            site->depth = depth;
+            for (uint32_t i = 0; i < depth; ++i) site->frames[i] = frames[i];
+            return index;
+        }
+
+        if (site->depth != depth) continue;
+
+        uint32_t i = 0;
+        while (i < depth && site->frames[i] == frames[i]) ++i;
+        if (i == depth) return index;
+    }
+}
+
+static void
+profileSample(MemArena *mem, size_t pos, size_t len, bool back)
+{
+    MemProfile *profile = mem->profile;
+    size_t period = profile->period;
+    size_t bytes = len;
+
+    // NOTE (Matteo): Small allocations account for a whole period for each sampling interval that
+    // elapsed during them, which makes the estimate unbiased; large ones are always sampled
+    if (len < period)
+    {
+        size_t left = g_profile_left ? g_profile_left : profileInterval(period);
+        size_t intervals = 0;
+
+        while (left <= len)
+        {
+            left += profileInterval(period);
+            ++intervals;
+        }
+
+        g_profile_left = left - len;
+        if (!intervals) return;
+        bytes = intervals * period;
+    }
+
+    void *frames[MEM_PROFILE_MAX_DEPTH];
+    uint32_t depth = captureStack(frames, MEM_PROFILE_MAX_DEPTH);
+
+    spinLock(&profile->lock);
+
+    size_t index = profileSite(profile, frames, depth);
+
+    if (index < profile->site_cap)
+    {
+        MemProfileSite *site = profile->sites + index;
+        size_t count = bytes / len;
+        site->total_count += count;
+        site->total_bytes += bytes;
+
+        if (profile->live_len < profile->live_cap)
+        {
+            site->live_count += count;
+            site->live_bytes += bytes;
+
+            profile->live[profile->live_len++] = (MemProfileSample){
+                .arena = mem,
+                .pos = pos,
+                .count = count,
+                .bytes = bytes,
+                .site = (uint32_t)index,
+                .back = back,
+            };
+
+            if (back && pos > mem->profile_back_top) atomicStore(&mem->profile_back_top, pos);
+            if (!back && pos >= mem->profile_top) atomicStore(&mem->profile_top, pos + 1);
+        }
+        else
+        {
+            ++profile->dropped;
+        }
+    }
+    else
+    {
+        ++profile->dropped;
+    }
+
+    spinUnlock(&profile->lock);
+}
+
+// Release the live samples of the arena that are past its current length (or all of them)
+static void
+profileRelease(MemArena *mem, bool all)
+{
+    MemProfile *profile = mem->profile;
+
+    spinLock(&profile->lock);
+
+    size_t len = all ? 0 : mem->base_pos + atomicLoad(&mem->len);
+    size_t back_len = all ? 0 : mem->back_len;
+    size_t top = 0;
+    size_t back_top = 0;
+
+    for (size_t i = 0; i < profile->live_len;)
+    {
+        MemProfileSample *sample = profile->live + i;
+
+        if (sample->arena != mem)
+        {
+            ++i;
+        }
+        else if (sample->back ? sample->pos > back_len : sample->pos >= len)
+        {
+            MemProfileSite *site = profile->sites + sample->site;
+            site->live_count -= sample->count;
+            site->live_bytes -= sample->bytes;
+            // NOTE (Matteo): Samples are unordered, so the last one fills the gap
+            *sample = profile->live[--profile->live_len];
+        }
+        else
+        {
+            if (sample->back && sample->pos > back_top) back_top = sample->pos;
+            if (!sample->back && sample->pos >= top) top = sample->pos + 1;
+            ++i;
+        }
+    }
+
+    atomicStore(&mem->profile_top, top);
+    atomicStore(&mem->profile_back_top, back_top);
+
+    spinUnlock(&profile->lock);
+}
+
+// Account for an allocation at the given position (see MemProfileSample)
+static inline void
+profileAlloc(MemArena *mem, size_t pos, size_t len, bool back)
+{
+    if (!mem->profile) return;
+
+    if (len < g_profile_left && len < mem->profile->period)
+    {
+        g_profile_left -= len;
+        return;
+    }
+
+    profileSample(mem, pos, len, back);
+}
+
+// NOTE (Matteo): The profiler is involved only if the arena shrinks past a live sample
+static inline void
+profileTrim(MemArena *mem)
+{
+    if (mem->profile && (mem->base_pos + atomicLoad(&mem->len) < atomicLoad(&mem->profile_top) ||
+                         mem->back_len < atomicLoad(&mem->profile_back_top)))
+    {
+        profileRelease(mem, false);
+    }
+}
+
+static inline void
+updateFastCap(MemArena *mem)
+{
+    // NOTE (Matteo): The inline fast path does not clear memory, so it is allowed only if all the
+    // committed memory past the current length is clear
+    // NOTE (Matteo): Concurrent arenas cannot bump the length without atomics
+    // NOTE (Matteo): The front end cannot grow into the memory used by the back end
+    bool clear = !(mem->flags & MEM_FLAG_NO_ZERO) || mem->dirty <= mem->len;
+    // NOTE (Matteo): Statistics, counters, probes, traces and profiles cannot be collected by the
+    // inline fast path
+#if defined(MEM_ENABLE_STATS) || defined(MEM_ENABLE_PERF) || defined(MEM_ENABLE_USDT)
+    bool fast = false;
+    (void)clear;
+#else
+    bool fast = clear && !(mem->flags & MEM_FLAG_CONCURRENT) && !mem->trace && !mem->profile;
+#endif
+    size_t front_cap = mem->cap - mem->back_len;
+    mem->fast_cap = !fast ? 0 : mem->commit < front_cap ? mem->commit : front_cap;
+
+    statsUpdatePeak(mem);
+    profileTrim(mem);
+}
+
+// Commit memory of the given arena
+static inline void
+commitArena(MemArena *mem, MemBlock block)
+{
+    // NOTE (Matteo): Avoid syscalls for no-ops
+    if (!block.len) return;
+
+    MEM_STAT_ADD(mem, commits, 1);
+    MEM_STAT_ADD(mem, commit_bytes, block.len);
+
+    uint64_t start = traceBegin(mem);
+    MEM_PROBE3(commit_begin, mem, block.ptr, block.len);
+    PerfSample begin = perfBegin();
+    commit(block);
+    perfEnd(mem, MEM_PERF_COMMIT, &begin);
+    MEM_PROBE3(commit_end, mem, block.ptr, block.len);
+    traceEvent(mem, MEM_TRACE_COMMIT, start, block.ptr, block.len, 0);
+}
+
+// Decommit memory of the given arena
+static inline void
+decommitArena(MemArena *mem, MemBlock block)
+{
+    // NOTE (Matteo): Avoid syscalls for no-ops
+    if (!block.len) return;
+
+    MEM_STAT_ADD(mem, decommits, 1);
+    MEM_STAT_ADD(mem, decommit_bytes, block.len);
+
+    uint64_t start = traceBegin(mem);
+    MEM_PROBE3(decommit_begin, mem, block.ptr, block.len);
+    PerfSample begin = perfBegin();
+
+    if (mem->flags & MEM_FLAG_CLONE)
+    {
+        // NOTE (Matteo): Dropping private pages would expose the content of the original file
+        remap(block);
+    }
+    else if (mem->flags & (MEM_FLAG_PERSISTENT | MEM_FLAG_SHARED | MEM_FLAG_CLONEABLE))
+    {
+        discard(block, mem->flags & MEM_FLAG_SHARED);
+    }
+    else
+    {
+        decommit(block);
+    }
+
+    perfEnd(mem, MEM_PERF_DECOMMIT, &begin);
+    MEM_PROBE3(decommit_end, mem, block.ptr, block.len);
+    traceEvent(mem, MEM_TRACE_DECOMMIT, start, block.ptr, block.len, 0);
+}
+
+// Commit the page storing the data structure of an arena, or of a block of a chained one
+// NOTE (Matteo): Only the probes are fired, because the data structure may not be initialized yet;
+// statistics, counters and traces cover the memory available for allocations
+static inline void
+commitHeader(MemArena *mem, uint8_t *base, size_t page_size)
+{
+    MemBlock block = {.ptr = base, .len = page_size};
+    MEM_PROBE3(commit_begin, mem, block.ptr, block.len);
+    commit(block);
+    MEM_PROBE3(commit_end, mem, block.ptr, block.len);
+}
+
+// Decommit the front end memory past the given offset
+static inline void
+decommitFront(MemArena *mem, size_t min_commit)
+{
+    // NOTE (Matteo): The committed ranges of the two ends may overlap, and the pages committed for
+    // the back end must be preserved
+    size_t limit = backEnd(mem) - mem->back_commit;
+    size_t end = mem->commit < limit ? mem->commit : limit;
+    if (end > min_commit)
+    {
+        decommitArena(mem, (MemBlock){.ptr = mem->ptr + min_commit, .len = end - min_commit});
+    }
+
+    mem->commit = min_commit;
+    if (mem->dirty > min_commit) mem->dirty = min_commit;
+#if defined(MEM_ENABLE_PERF)
+    if (mem->perf_touched > min_commit) mem->perf_touched = min_commit;
+#endif
+}
+
+static inline void
+adjustCommited(MemArena *mem, size_t prev_len)
+{
+    if (mem->len > mem->commit)
+    {
+        size_t next_commit = commitTarget(mem, mem->len);
+        MemBlock block = {.ptr = mem->ptr + mem->commit, .len = next_commit - mem->commit};
+        commitArena(mem, block);
+        mem->commit = next_commit;
+    }
+    else if (mem->len < prev_len)
+    {
+        size_t min_commit = commitTarget(mem, mem->len);
+
+        if (mem->dirty < prev_len) mem->dirty = prev_len;
+
+        // NOTE (Matteo): Unused memory is decommitted only for safety reasons, in order to trigger
+        // an error if is accessed; the threshold allows to keep some slack committed in order to
+        // avoid a syscall per operation.
+        if (!(mem->flags & MEM_FLAG_UNSAFE) && mem->commit > min_commit &&
+            mem->commit - min_commit > mem->decommit_threshold)
+        {
+            decommitFront(mem, min_commit);
+        }
+
+        // NOTE (Matteo): Freshly committed memory is cleared to zero by default; for consistency
+        // all the released memory that is not decommitted is cleared too, unless the arena defers
+        // zeroing to allocation time. Memory past the dirty mark (which covers the previous length)
+        // is already clear.
+        if (!(mem->flags & MEM_FLAG_NO_ZERO))
+        {
+            size_t zero_end = mem->dirty < mem->commit ? mem->dirty : mem->commit;
+            if (zero_end > mem->len) zeroArena(mem, mem->ptr + mem->len, zero_end - mem->len);
+            mem->dirty = 0;
+        }
+    }
+
+    updateFastCap(mem);
+}
+
+// Same as adjustCommited, for the back end
+static inline void
+adjustCommitedBack(MemArena *mem, size_t prev_back_len)
+{
+    uint8_t *end = mem->ptr + backEnd(mem);
+    uint8_t *start = end - mem->back_commit;
+    uint8_t *used = mem->ptr + mem->cap - mem->back_len;
+
+    if (used < start)
+    {
+        // NOTE (Matteo): The back end may share the first page with the arena data structure
+        uint8_t *min_start = (uint8_t *)alignBackward((size_t)mem->ptr, mem->page_size);
+        uint8_t *next_start = (uint8_t *)alignBackward((size_t)used, mem->commit_size);
+        if (next_start < min_start) next_start = min_start;
+
+        commitArena(mem, (MemBlock){.ptr = next_start, .len = (size_t)(start - next_start)});
+        mem->back_commit = (size_t)(end - next_start);
+    }
+    else if (mem->back_len < prev_back_len)
+    {
+        uint8_t *prev_used = mem->ptr + mem->cap - prev_back_len;
+        uint8_t *min_start = (uint8_t *)alignBackward((size_t)used, mem->commit_size);
+
+        if (!(mem->flags & MEM_FLAG_UNSAFE) && min_start > start &&
+            (size_t)(min_start - start) > mem->decommit_threshold)
+        {
+            // NOTE (Matteo): Pages committed for the front end must be preserved
+            uint8_t *front_end =
+                (uint8_t *)alignForward((size_t)(mem->ptr + mem->commit), mem->page_size);
+            uint8_t *from = start > front_end ? start : front_end;
+            if (min_start > from)
+            {
+                decommitArena(mem, (MemBlock){.ptr = from, .len = (size_t)(min_start - from)});
+            }
+
+            mem->back_commit = (size_t)(end - min_start);
+            start = min_start;
+        }
+
+        // NOTE (Matteo): Released memory is always cleared, because it may be reused by the front
+        // end, which does not track it as dirty
+        uint8_t *zero_start = prev_used > start ? prev_used : start;
+        if (used > zero_start) zeroArena(mem, zero_start, (size_t)(used - zero_start));
+    }
+
+    updateFastCap(mem);
+}
+
+static inline void
+prepareBlock(MemArena *mem, uint8_t *ptr, size_t len, bool zero)
+{
+    // NOTE (Matteo): Released memory is already clear, unless zeroing is deferred or the memory
+    // was released by shrinking a block of a concurrent arena; in that case only the portion that
+    // may be dirty must be cleared (always, if the arena does not defer zeroing).
+    bool concurrent = (mem->flags & MEM_FLAG_CONCURRENT);
+    if (!(mem->flags & MEM_FLAG_NO_ZERO))
+    {
+        if (!concurrent) return;
+        zero = true;
+    }
+
+    size_t start = (size_t)(ptr - mem->ptr);
+    size_t end = start + len;
+    size_t dirty = concurrent ? atomicLoad(&mem->dirty) : mem->dirty;
+
+    if (zero && dirty > start) zeroArena(mem, ptr, (end < dirty ? end : dirty) - start);
+
+    // NOTE (Matteo): The dirty mark is read-only for concurrent allocations, because a block
+    // covering it does not imply that blocks handed out concurrently have been cleared yet
+    if (concurrent) return;
+
+    // NOTE (Matteo): Once the block covers all the dirty memory, the rest of the arena is clear
+    if (mem->dirty <= end) mem->dirty = 0;
+
+    updateFastCap(mem);
+}
+
+static void
+ensureCommitted(MemArena *mem, size_t len)
+{
+    while (atomicLoad(&mem->commit) < len)
+    {
+        size_t unlocked = 0;
+        if (atomicCas(&mem->commit_lock, &unlocked, 1))
+        {
+            size_t curr_commit = mem->commit;
+            if (curr_commit < len)
+            {
+                // NOTE (Matteo): Commit for all the space reserved so far, so that threads waiting
+                // for the lock are likely served by the same syscall
+                size_t reserved = atomicLoad(&mem->len);
+                size_t next_commit = commitTarget(mem, reserved > len ? reserved : len);
+                commitArena(mem, (MemBlock){.ptr = mem->ptr + curr_commit,
+                                            .len = next_commit - curr_commit});
+                atomicStore(&mem->commit, next_commit);
+            }
+            atomicStore(&mem->commit_lock, 0);
+        }
+        else
+        {
+            yieldThread();
+        }
+    }
+}
+
+static MemBlock
+allocConcurrent(MemArena *mem, size_t len, size_t alignment, bool zero)
+{
+    MemBlock block = {0};
+    if (!len) return block;
+
+    size_t prev_len = atomicLoad(&mem->len);
+    size_t next_len;
+
+    do
+    {
+        size_t offset = alignForward((size_t)(mem->ptr + prev_len), alignment) - (size_t)mem->ptr;
+        next_len = offset + len;
+        if (next_len > mem->cap || next_len < offset) return block;
+        block.ptr = mem->ptr + offset;
+    } while (!atomicCas(&mem->len, &prev_len, next_len));
+
+    block.len = len;
+    MEM_STAT_ADD(mem, allocs, 1);
+    MEM_STAT_ADD(mem, align_padding, next_len - len - prev_len);
+    traceEvent(mem, MEM_TRACE_ALLOC, 0, block.ptr, len, alignment);
+    ensureCommitted(mem, next_len);
+    statsUpdatePeak(mem);
+    prepareBlock(mem, block.ptr, block.len, zero);
+    profileAlloc(mem, next_len - len, len, false);
+    // NOTE (Matteo): Memory must be cleared to 0 if required
+    MEM_ASSERT(!zero || block.ptr[0] == 0);
+
+    return block;
+}
+
+static bool
+resizeConcurrent(MemArena *mem, MemBlock *block, size_t new_len, bool zero)
+{
+    if (!block || !block->ptr) return false;
+
+    size_t block_start = (size_t)(block->ptr - mem->ptr);
+    size_t block_end = block_start + block->len;
+    if (new_len > mem->cap - block_start) return false;
+    size_t next_len = block_start + new_len;
+
+    // NOTE (Matteo): Released memory cannot be cleared, since the block may not be the last one
+    // (in which case its content must be preserved) and another thread may allocate the memory
+    // right after it is published; it is marked as dirty beforehand instead, so that allocations
+    // clear it (see prepareBlock). A failed operation just leaves the mark higher than needed.
+    if (new_len < block->len) atomicMax(&mem->dirty, block_end);
+
+    // NOTE (Matteo): The block can be resized only if it is still the last one
+    size_t expected = block_end;
+    if (!atomicCas(&mem->len, &expected, next_len)) return false;
+
+    if (new_len > block->len)
+    {
+        ensureCommitted(mem, next_len);
+        statsUpdatePeak(mem);
+        prepareBlock(mem, block->ptr + block->len, new_len - block->len, zero);
+    }
+    else
+    {
+        profileTrim(mem);
+    }
+
+    // NOTE (Matteo): Empty blocks are not accessible
+    if (!new_len) block->ptr = NULL;
+
+    block->len = new_len;
+    return true;
+}
+
+// NOTE (Matteo): Chained arenas keep the state of the current block in the arena data structure,
+// so that all the other functions (and the inline fast path) work unchanged; the header page of
+// each additional block stores the state of the previous block, forming a stack.
+
+static inline void
+copyBlockState(MemArena *dst, MemArena const *src)
+{
+    dst->ptr = src->ptr;
+    dst->len = src->len;
+    dst->cap = src->cap;
+    dst->commit = src->commit;
+    dst->reserved = src->reserved;
+    dst->dirty = src->dirty;
+    dst->base_pos = src->base_pos;
+    dst->prev = src->prev;
+}
+
+static bool
+growChain(MemArena *mem, size_t len, size_t alignment)
+{
+    size_t page_size = mem->page_size;
+
+    // NOTE (Matteo): Block memory is page aligned, so only larger alignments require padding
+    size_t min_cap = len + (alignment > page_size ? alignment : 0);
+    if (min_cap < len) return false;
+
+    MemArena *block = NULL;
+
+    // NOTE (Matteo): Retained blocks are reused if large enough
+    for (MemArena **link = &mem->spare; *link; link = &(*link)->prev)
+    {
+        if ((*link)->cap >= min_cap)
+        {
+            block = *link;
+            *link = block->prev;
+            break;
+        }
+    }
+
+    if (!block)
+    {
+        size_t cap = mem->cap;
+        cap = (cap > SIZE_MAX / mem->chain_grow_f) ? min_cap : cap * mem->chain_grow_f;
+        if (cap < min_cap) cap = min_cap;
+
+        uint8_t *base;
+        size_t total_size;
+
+        for (;;)
+        {
+            total_size = alignForward(cap, page_size) + page_size;
+            base = total_size > cap ? reserve(total_size) : NULL;
+            // NOTE (Matteo): Fall back to the minimum size if the address space is exhausted
+            if (base || cap == min_cap) break;
+            cap = min_cap;
+        }
+
+        if (!base) return false;
+
+        commitHeader(mem, base, page_size);
+
+        block = (MemArena *)base;
+        block->ptr = base + page_size;
+        block->cap = total_size - page_size;
+        block->reserved = total_size;
+    }
+
+    // NOTE (Matteo): The arena now describes the new block, whose header stores the state of the
+    // current one
+    MemArena curr;
+    copyBlockState(&curr, mem);
+    copyBlockState(mem, block);
+    copyBlockState(block, &curr);
+
+    mem->len = 0;
+    mem->base_pos = curr.base_pos + curr.len;
+    mem->prev = block;
+#if defined(MEM_ENABLE_PERF)
+    mem->perf_touched = 0;
+#endif
+    updateFastCap(mem);
+
+    return true;
+}
+
+static void
+popChain(MemArena *mem)
+{
+    MemArena *block = mem->prev;
+    MEM_ASSERT(block);
+
+    MemArena curr;
+    copyBlockState(&curr, mem);
+    copyBlockState(mem, block);
+#if defined(MEM_ENABLE_PERF)
+    // NOTE (Matteo): The committed memory of previous blocks is regarded as touched
+    mem->perf_touched = mem->commit;
+#endif
+
+    if (mem->flags & MEM_FLAG_CHAIN_RETAIN)
+    {
+        decommitArena(mem, (MemBlock){.ptr = curr.ptr, .len = curr.commit});
+
+        copyBlockState(block, &curr);
+        block->len = 0;
+        block->commit = 0;
+        block->dirty = 0;
+        block->base_pos = 0;
+        block->prev = mem->spare;
+        mem->spare = block;
+    }
+    else
+    {
+        release((MemBlock){.ptr = (uint8_t *)block, .len = curr.reserved});
+    }
+}
+
+// NOTE (Matteo): Registered arenas form a doubly linked list, most recent first
+static MemArena *g_registry;
+static size_t g_registry_lock;
+
+static void
+registerArena(MemArena *mem)
+{
+    spinLock(&g_registry_lock);
+
+    mem->registry_prev = NULL;
+    mem->registry_next = g_registry;
+    if (g_registry) g_registry->registry_prev = mem;
+    g_registry = mem;
+
+    spinUnlock(&g_registry_lock);
+}
+
+static void
+unregisterArena(MemArena *mem)
+{
+    spinLock(&g_registry_lock);
+
+    if (mem->registry_prev)
+    {
+        mem->registry_prev->registry_next = mem->registry_next;
+    }
+    else
+    {
+        g_registry = mem->registry_next;
+    }
+
+    if (mem->registry_next) mem->registry_next->registry_prev = mem->registry_prev;
+
+    spinUnlock(&g_registry_lock);
+}
+
+//=== Interface functions ===//
+
+void
+memRelease(MemArena *mem)
+{
+    MEM_ASSERT(mem);
+    // NOTE (Matteo): Forked arenas must be joined instead
+    MEM_ASSERT(!mem->parent);
+
+    MEM_PROBE1(release, mem);
+
+    if (mem->name[0]) unregisterArena(mem);
+    if (mem->profile) profileRelease(mem, true);
+
+    while (mem->prev) popChain(mem);
+
+    for (MemArena *block = mem->spare; block;)
+    {
+        MemArena *next = block->prev;
+        release((MemBlock){.ptr = (uint8_t *)block, .len = block->reserved});
+        block = next;
+    }
+
+    // NOTE (Matteo): The content of persistent arenas must be retained, and shared memory may still
+    // be in use by other processes (or clones)
+    if (!(mem->flags & (MEM_FLAG_PERSISTENT | MEM_FLAG_SHARED | MEM_FLAG_CLONEABLE)))
+    {
+        decommitArena(mem, (MemBlock){.ptr = mem->ptr, .len = mem->commit});
+    }
+
+    if (mem->flags & MEM_FLAG_CLONEABLE) closeFile(mem->fd);
+
+    release((MemBlock){.ptr = (uint8_t *)mem, .len = mem->reserved});
+}
+
+bool
+memSync(MemArena *mem)
+{
+    MEM_ASSERT(mem);
+
+    while (mem->parent) mem = mem->parent;
+    if (!(mem->flags & MEM_FLAG_PERSISTENT)) return true;
+
+    return syncFile((MemBlock){.ptr = (uint8_t *)mem, .len = mem->reserved});
+}
+
+MemArena *
+memClone(MemArena *mem)
+{
+    MEM_ASSERT(mem && !mem->parent);
+
+    if (!(mem->flags & MEM_FLAG_CLONEABLE)) return NULL;
+
+    // NOTE (Matteo): The clone has its own data structure, while the memory is a private view of
+    // the file backing the original arena
+    size_t page_size = mem->page_size;
+    uint8_t *base = mapClone(mem->fd, mem->reserved, page_size);
+    if (!base) return NULL;
+
+    commitHeader((MemArena *)base, base, page_size);
+
+    MemArena *clone = (MemArena *)base;
+    *clone = *mem;
+    clone->ptr = base + page_size;
+    clone->flags = (mem->flags & ~(uint32_t)MEM_FLAG_CLONEABLE) | MEM_FLAG_CLONE;
+    clone->fd = -1;
+    clone->commit_lock = 0;
+    clone->trace = NULL;
+    clone->profile = NULL;
+    clone->profile_top = 0;
+    clone->profile_back_top = 0;
+#if defined(MEM_ENABLE_PERF)
+    // NOTE (Matteo): Pages of the clone are copied on the first write
+    clone->perf_touched = 0;
+#endif
+    if (clone->name[0]) registerArena(clone);
+
+    // NOTE (Matteo): The view is not accessible, so the committed ranges must be restored
+    commitArena(clone, (MemBlock){.ptr = clone->ptr, .len = clone->commit});
+    commitArena(clone, (MemBlock){
+        .ptr = clone->ptr + backEnd(clone) - clone->back_commit,
+        .len = clone->back_commit,
+    });
+
+    updateFastCap(clone);
+
+    return clone;
+}
+
+// Restore a persistent arena from the mapped file
+static MemArena *
+reopenArena(uint8_t *base, size_t size, size_t page_size, bool shared)
+{
+    MemArena *mem = (MemArena *)base;
+
+    // NOTE (Matteo): The stored state is used as is, provided that it was written by a compatible
+    // build at the same address; the file must also be mapped in the mode it was created with,
+    // since the protection of the mapping depends on it
+    if (mem->magic != MEM_PERSIST_MAGIC || mem->ptr != base + page_size ||
+        mem->page_size != page_size || mem->reserved != size || mem->parent || mem->prev ||
+        !(mem->flags & MEM_FLAG_SHARED) != !shared)
+    {
+        release((MemBlock){.ptr = base, .len = size});
+        return NULL;
+    }
+
+    // NOTE (Matteo): Shared arenas may be in use by other processes, so their state is left as is
+    if (mem->flags & MEM_FLAG_SHARED) return mem;
+
+    mem->commit_lock = 0;
+    mem->trace = NULL;
+    mem->profile = NULL;
+    mem->profile_top = 0;
+    mem->profile_back_top = 0;
+#if defined(MEM_ENABLE_PERF)
+    mem->perf_touched = 0;
+#endif
+
+    // NOTE (Matteo): The mapping is not accessible, so the committed ranges must be restored
+    commitArena(mem, (MemBlock){.ptr = mem->ptr, .len = mem->commit});
+    commitArena(mem, (MemBlock){
+        .ptr = mem->ptr + backEnd(mem) - mem->back_commit,
+        .len = mem->back_commit,
+    });
+
+    updateFastCap(mem);
+
+    // NOTE (Matteo): The name is stored along with the arena, while the stale links are discarded
+    if (mem->name[0]) registerArena(mem);
+
+    return mem;
+}
+
+MemArena *
+memReserve(MemArenaInfo const *info)
+{
+    // NOTE (Matteo): A single page is committed to store the allocator data structure. This is
+    // a bit wasteful, but allows memory protection to work for all subsequent allocations
+    size_t page_size = pageSize();
+    MemBlock block = {.len = page_size};
+
+    size_t commit_size = info->commit_size;
+    if (commit_size < page_size) commit_size = page_size;
+    // NOTE (Matteo): Commit granularity must be a power of 2
+    MEM_ASSERT((commit_size & (commit_size - 1)) == 0);
+
+    // NOTE (Matteo): If the total allocation size is not provided, it is deduced from the required
+    // available size, plus the space required to store the allocator data structure
+    size_t total_size = info->total_size;
+    size_t avail_size = info->available_size;
+
+    if (!total_size)
+    {
+        MEM_ASSERT(avail_size);
+        total_size = avail_size + block.len;
+    }
+
+    if (!avail_size)
+    {
+        MEM_ASSERT(total_size);
+        avail_size = total_size - block.len;
+    }
+
+    // NOTE (Matteo): The reservation must span whole pages
+    total_size = alignForward(total_size, page_size);
+    MEM_ASSERT(avail_size <= total_size - block.len);
+
+    // NOTE (Matteo): Reserve a block of virtual memory from the OS and keep it protected, except
+    // for the space used to store the allocator data structure
+    bool persistent = (info->file_path != NULL);
+    bool created = true;
+    int fd = -1;
+    size_t file_size = total_size;
+
+    if (persistent)
+    {
+        MEM_ASSERT(info->base_address);
+        MEM_ASSERT(((size_t)info->base_address & (page_size - 1)) == 0);
+        MEM_ASSERT(!info->chained);
+        block.ptr =
+            mapFile(info->file_path, info->base_address, &file_size, info->shared, &created);
+    }
+    else if (info->shared)
+    {
+        MEM_ASSERT(!info->chained);
+        block.ptr = reserveShared(total_size);
+    }
+    else if (info->cloneable)
+    {
+        MEM_ASSERT(!info->chained);
+        block.ptr = reserveFile(total_size, &fd);
+        // NOTE (Matteo): Fall back to a regular arena, which cannot be cloned
+        if (!block.ptr) block.ptr = reserve(total_size);
+    }
+    else
+    {
+        block.ptr = reserve(total_size);
+    }
+
+    if (!block.ptr) return NULL;
+
+    MEM_ASSERT(sizeof(MemArena) <= page_size);
+    if (!info->shared) commitHeader((MemArena *)block.ptr, block.ptr, page_size);
+
+    // NOTE (Matteo): An empty file is initialized like a regular reservation
+    if (!created)
+    {
+        MemArena *mem = reopenArena(block.ptr, file_size, page_size, info->shared);
+        if (mem) MEM_PROBE2(reserve, mem, file_size);
+        return mem;
+    }
+
+    MemArena *mem = (MemArena *)block.ptr;
+
+    mem->ptr = block.ptr + page_size;
+    mem->cap = avail_size;
+    mem->len = 0;
+    mem->commit = 0;
+    mem->page_size = page_size;
+    mem->reserved = total_size;
+    mem->commit_size = commit_size;
+    mem->decommit_threshold = info->decommit_threshold;
+    mem->flags |= (MEM_FLAG_UNSAFE & boolMask(info->unsafe));
+    mem->flags |= (MEM_FLAG_NO_ZERO & boolMask(info->no_zero));
+    mem->flags |= (MEM_FLAG_CONCURRENT & boolMask(info->concurrent || info->shared));
+    mem->flags |= (MEM_FLAG_CHAINED & boolMask(info->chained));
+    mem->flags |= (MEM_FLAG_CHAIN_RETAIN & boolMask(info->chain_retain));
+    mem->chain_grow_f = info->chain_grow_f ? info->chain_grow_f : 2;
+
+    if (info->shared)
+    {
+        // NOTE (Matteo): Shared memory is accessible from the start, so it is regarded as committed
+        mem->flags |= MEM_FLAG_SHARED;
+        mem->commit = backEnd(mem);
+    }
+
+    if (persistent)
+    {
+        mem->flags |= MEM_FLAG_PERSISTENT;
+        mem->magic = MEM_PERSIST_MAGIC;
+    }
+
+    if (fd >= 0)
+    {
+        mem->flags |= MEM_FLAG_CLONEABLE;
+        mem->fd = fd;
+    }
+
+    // NOTE (Matteo): Switching blocks would require synchronization
+    MEM_ASSERT(!(info->concurrent && info->chained));
+
+    if (info->name && info->name[0])
+    {
+        // NOTE (Matteo): The registry links would be shared with other processes
+        MEM_ASSERT(!info->shared);
+
+        for (size_t i = 0; i < MEM_ARENA_NAME_LEN - 1 && info->name[i]; ++i)
+        {
+            mem->name[i] = info->name[i];
+        }
+
+        mem->tag = info->tag;
+        registerArena(mem);
+    }
+
+    MEM_PROBE2(reserve, mem, total_size);
+
+    return mem;
+}
+
+void
+memClear(MemArena *mem)
+{
+    MEM_ASSERT(mem);
+
+    MEM_PROBE1(clear, mem);
+    traceEvent(mem, MEM_TRACE_CLEAR, 0, mem->ptr, mem->base_pos + mem->len, 0);
+    memRestore(mem, (MemArenaMark){0});
+    if (mem->back_len) memClearBack(mem);
+}
+
+void
+memTrim(MemArena *mem, size_t keep_bytes)
+{
+    MEM_ASSERT(mem);
+
+    size_t slack = mem->commit - mem->len;
+    if (keep_bytes >= slack) return;
+
+    size_t base = (size_t)mem->ptr;
+    size_t min_commit = alignForward(base + mem->len + keep_bytes, mem->page_size) - base;
+    if (min_commit < mem->commit)
+    {
+        decommitFront(mem, min_commit);
+        updateFastCap(mem);
+    }
+}
+
+static MemBlock
+allocBlock(MemArena *mem, size_t len, size_t alignment, bool zero)
+{
+    MEM_ASSERT(mem);
+
+    if (mem->flags & MEM_FLAG_CONCURRENT) return allocConcurrent(mem, len, alignment, zero);
+
+    MemBlock block = {
+        .ptr = (uint8_t *)alignForward((size_t)(mem->ptr + mem->len), alignment),
+    };
+
+    size_t next_len = len + (block.ptr - mem->ptr);
+    if (next_len > mem->cap - mem->back_len || len == 0)
+    {
+        // NOTE (Matteo): The new block is guaranteed to fit the allocation
+        if (len && (mem->flags & MEM_FLAG_CHAINED) && growChain(mem, len, alignment))
+        {
+            return allocBlock(mem, len, alignment, zero);
+        }
+
+        block.ptr = NULL;
+    }
+    else
+    {
+        block.len = len;
+        size_t prev_len = mem->len;
+        mem->len = next_len;
+        MEM_STAT_ADD(mem, allocs, 1);
+        MEM_STAT_ADD(mem, align_padding, next_len - len - prev_len);
+        traceEvent(mem, MEM_TRACE_ALLOC, 0, block.ptr, len, alignment);
+        adjustCommited(mem, prev_len);
+        prepareBlock(mem, block.ptr, block.len, zero);
+        touchArena(mem, next_len);
+        profileAlloc(mem, mem->base_pos + next_len - len, len, false);
+        // NOTE (Matteo): Memory must be cleared to 0 if required
+        MEM_ASSERT(!zero || block.ptr[0] == 0);
+    }
+
+    return block;
+}
+
+static bool
+resizeSerial(MemArena *mem, MemBlock *block, size_t new_len, bool zero)
+{
+    if (!lastAlloc(mem, block)) return false;
+
+    size_t prev_len = mem->len;
+
+    if (new_len < block->len)
+    {
+        mem->len -= (block->len - new_len);
+        adjustCommited(mem, prev_len);
+    }
+    else
+    {
+        size_t request = new_len - block->len;
+        if (request > memAvailable(mem)) return false;
+        mem->len += request;
+        adjustCommited(mem, prev_len);
+        prepareBlock(mem, block->ptr + block->len, request, zero);
+        // NOTE (Matteo): Grown memory must be cleared to 0 if required
+        MEM_ASSERT(!zero || !request || block->ptr[block->len] == 0);
+    }
+
+    // NOTE (Matteo): Empty blocks are not accessible
+    if (!new_len) block->ptr = NULL;
+
+    block->len = new_len;
+    return true;
+}
+
+static bool
+resizeBlock(MemArena *mem, MemBlock *block, size_t new_len, bool zero)
+{
+    MEM_ASSERT(mem);
+
+    // NOTE (Matteo): The block pointer is reset by frees
+    uint8_t *ptr = block ? block->ptr : NULL;
+    size_t prev_len = block ? block->len : 0;
+
+    bool result = (mem->flags & MEM_FLAG_CONCURRENT) ? resizeConcurrent(mem, block, new_len, zero)
+                                                     : resizeSerial(mem, block, new_len, zero);
+
+    MEM_PROBE4(resize, mem, ptr, new_len, (int)result);
+    if (result) traceEvent(mem, MEM_TRACE_RESIZE, 0, ptr, new_len, 0);
+
+    // NOTE (Matteo): Growth is sampled like a new allocation of the additional memory
+    if (result && new_len > prev_len)
+    {
+        profileAlloc(mem, mem->base_pos + (size_t)(ptr - mem->ptr) + prev_len, new_len - prev_len,
+                     false);
+    }
+
+#if defined(MEM_ENABLE_STATS)
+    if (!new_len)
+    {
+        MEM_STAT_ADD(mem, frees, 1);
+        if (!result) MEM_STAT_ADD(mem, failed_frees, 1);
+    }
+    else if (result)
+    {
+        MEM_STAT_ADD(mem, resizes, 1);
+    }
+#endif
+
+    return result;
+}
+
+// NOTE (Matteo): Probes are fired here rather than in allocBlock, which recurses for chained arenas
+static inline MemBlock
+probeAlloc(MemArena *mem, MemBlock block, size_t len, size_t alignment)
+{
+    if (block.ptr)
+    {
+        MEM_PROBE4(alloc, mem, block.ptr, len, alignment);
+    }
+    else
+    {
+        MEM_PROBE3(alloc_fail, mem, len, alignment);
+    }
+
+    return block;
+}
+
+MemBlock
+memAlloc(MemArena *mem, size_t len, size_t alignment)
+{
+    return probeAlloc(mem, allocBlock(mem, len, alignment, true), len, alignment);
+}
+
+MemBlock
+memAllocUninit(MemArena *mem, size_t len, size_t alignment)
+{
+    return probeAlloc(mem, allocBlock(mem, len, alignment, false), len, alignment);
+}
+
+bool
+memResize(MemArena *mem, MemBlock *block, size_t new_len)
+{
+    return resizeBlock(mem, block, new_len, true);
+}
+
+bool
+memResizeUninit(MemArena *mem, MemBlock *block, size_t new_len)
+{
+    return resizeBlock(mem, block, new_len, false);
+}
+
+size_t
+memAvailable(MemArena *mem)
+{
+    MEM_ASSERT(mem);
+    return mem->cap - mem->back_len - atomicLoad(&mem->len);
+}
+
+MemArenaMark
+memSave(MemArena *mem)
+{
+    MEM_ASSERT(mem);
+    return (MemArenaMark){.pos = mem->base_pos + mem->len};
+}
+
+void
+memRestore(MemArena *mem, MemArenaMark mark)
+{
+    MEM_ASSERT(mem);
+    // NOTE (Matteo): Restoring an invalidated savepoint is a usage error
+    MEM_ASSERT(mark.pos <= mem->base_pos + mem->len);
+
+    // NOTE (Matteo): The start of a block matches the end of the previous one, which is preferred
+    // so that the block can be released
+    while (mem->prev && mark.pos <= mem->base_pos) popChain(mem);
+
+    size_t prev_len = mem->len;
+    mem->len = mark.pos - mem->base_pos;
+    adjustCommited(mem, prev_len);
+}
+
+MemBlock
+memAllocBack(MemArena *mem, size_t len, size_t alignment)
+{
+    MEM_ASSERT(mem);
+    MEM_ASSERT(!(mem->flags & (MEM_FLAG_CONCURRENT | MEM_FLAG_CHAINED)));
+
+    MemBlock block = {0};
+
+    size_t top = (size_t)(mem->ptr + mem->cap - mem->back_len);
+    size_t bottom = (size_t)(mem->ptr + mem->len);
+    if (!len || top - bottom < len) return probeAlloc(mem, block, len, alignment);
+
+    size_t start = alignBackward(top - len, alignment);
+    if (start < bottom) return probeAlloc(mem, block, len, alignment);
+
+    size_t prev_back_len = mem->back_len;
+    mem->back_len = (size_t)(mem->ptr + mem->cap) - start;
+    adjustCommitedBack(mem, prev_back_len);
+
+    // NOTE (Matteo): Memory released by the front end may be dirty if zeroing is deferred; once
+    // cleared, the dirty mark can be lowered, since the back end clears the memory it releases
+    size_t offset = start - (size_t)mem->ptr;
+    if ((mem->flags & MEM_FLAG_NO_ZERO) && mem->dirty > offset)
+    {
+        size_t end = top - (size_t)mem->ptr;
+        zeroArena(mem, (uint8_t *)start, (mem->dirty < end ? mem->dirty : end) - offset);
+        mem->dirty = offset;
+        updateFastCap(mem);
+    }
+
+    MEM_STAT_ADD(mem, allocs, 1);
+    MEM_STAT_ADD(mem, align_padding, top - len - start);
+    traceEvent(mem, MEM_TRACE_ALLOC, 0, (uint8_t *)start, len, alignment);
+    profileAlloc(mem, mem->back_len, len, true);
+
+    block.ptr = (uint8_t *)start;
+    block.len = len;
+    // NOTE (Matteo): Memory must be always cleared to 0
+    MEM_ASSERT(block.ptr[0] == 0);
+
+    return probeAlloc(mem, block, len, alignment);
+}
+
+MemArenaMark
+memSaveBack(MemArena *mem)
+{
+    MEM_ASSERT(mem);
+    return (MemArenaMark){.pos = mem->back_len};
+}
+
+void
+memRestoreBack(MemArena *mem, MemArenaMark mark)
+{
+    MEM_ASSERT(mem);
+    // NOTE (Matteo): Restoring an invalidated savepoint is a usage error
+    MEM_ASSERT(mark.pos <= mem->back_len);
+
+    size_t prev_back_len = mem->back_len;
+    mem->back_len = mark.pos;
+    adjustCommitedBack(mem, prev_back_len);
+}
+
+void *
+memReallocBufEx(MemArena *mem, MemBufInfo const *info)
+{
+    MEM_ASSERT(mem);
+    MEM_ASSERT(info);
+    MEM_ASSERT(info->curr_cap_ptr);
+
+    size_t target_cap = info->required_cap;
+    size_t curr_cap = *info->curr_cap_ptr;
+
+    // NOTE (Matteo): Exit early if possible
+    if (target_cap == curr_cap) return info->curr_buf;
+
+    if (!info->strict_cap)
+    {
+        // TODO (Matteo): Is this a real case?
+        // NOTE (Matteo): In case a stricly lower capacity is required, we honor
+        // it by reallocating; otherwise we can leave it as is.
+        if (target_cap < curr_cap) return info->curr_buf;
+
+        uint8_t grow_f = info->grow_f;
+        if (!grow_f) grow_f = 2;
+
+        size_t next_cap = curr_cap;
+        if (!next_cap) next_cap = target_cap;
+
+        while (next_cap < target_cap)
+        {
+            next_cap *= grow_f;
+        }
+
+        target_cap = next_cap;
+    }
+
+    MEM_ASSERT(target_cap > curr_cap || info->strict_cap);
+
+    MemBlock old_block = {.ptr = info->curr_buf, .len = curr_cap * info->item_size};
+    size_t new_size = target_cap * info->item_size;
+
+    if (resizeBlock(mem, &old_block, new_size, !info->uninit))
+    {
+        *info->curr_cap_ptr = target_cap;
+        return old_block.ptr;
+    }
+
+    MemBlock new_block = allocBlock(mem, new_size, info->item_align, !info->uninit);
+    if (new_block.ptr)
+    {
+        // NOTE (Matteo): Copy and free old data
+        size_t copy_len = old_block.len < new_size ? old_block.len : new_size;
+        if (copy_len) MEM_COPY(new_block.ptr, old_block.ptr, copy_len);
+        if (old_block.ptr && !memFree(mem, &old_block))
+        {
+            MEM_STAT_ADD(mem, realloc_leaked, old_block.len);
+        }
+
+        *info->curr_cap_ptr = target_cap;
+        return new_block.ptr;
+    }
+
+    return NULL;
+}
+
+//=== Compressed references ===//
+
+MemRef
+memRefEncodeScaled(MemArena *mem, void const *ptr, uint32_t shift)
+{
+    MEM_ASSERT(mem);
+
+    MemRef ref = {0};
+    if (!ptr) return ref;
+
+    // NOTE (Matteo): Pointers into other blocks of a chained arena are out of range
+    uint8_t const *bytes = (uint8_t const *)ptr;
+    MEM_ASSERT(bytes >= mem->ptr && bytes < mem->ptr + mem->cap);
+
+    size_t offset = (size_t)(bytes - mem->ptr);
+    MEM_ASSERT((offset & (((size_t)1 << shift) - 1)) == 0);
+    MEM_ASSERT((offset >> shift) <= UINT32_MAX - 1);
+
+    // NOTE (Matteo): Offsets are biased by 1, so that the start of the memory can be referenced
+    ref.val = (uint32_t)((offset >> shift) + 1);
+    return ref;
+}
+
+//=== Statistics ===//
+
+bool
+memGetStats(MemArena *mem, MemArenaStats *stats)
+{
+    MEM_ASSERT(mem && stats);
+
+#if defined(MEM_ENABLE_STATS)
+    statsUpdatePeak(mem);
+    *stats = mem->stats;
+    stats->len = mem->base_pos + atomicLoad(&mem->len);
+    stats->commit = commitLen(mem);
+    return true;
+#else
+    (void)mem;
+    *stats = (MemArenaStats){0};
+    return false;
+#endif
+}
+
+void
+memResetPeak(MemArena *mem)
+{
+    MEM_ASSERT(mem);
+
+#if defined(MEM_ENABLE_STATS)
+    atomicStore(&mem->stats.peak_len, mem->base_pos + atomicLoad(&mem->len));
+    atomicStore(&mem->stats.peak_commit, commitLen(mem));
+#else
+    (void)mem;
+#endif
+}
+
+//=== Performance counters ===//
+
+bool
+memGetPerf(MemArena *mem, MemPerfStats *perf)
+{
+    MEM_ASSERT(mem && perf);
+
+    *perf = (MemPerfStats){0};
+
+#if defined(MEM_ENABLE_PERF)
+    for (size_t op = 0; op < MEM_PERF_OP_COUNT; ++op)
+    {
+        MemPerfCounters *counters = mem->perf + op;
+        perf->ops[op] = (MemPerfCounters){
+            .count = atomicLoad(&counters->count),
+            .time_ns = atomicLoad(&counters->time_ns),
+            .page_faults = atomicLoad(&counters->page_faults),
+            .dtlb_misses = atomicLoad(&counters->dtlb_misses),
+            .cycles = atomicLoad(&counters->cycles),
+        };
+    }
+
+    // NOTE (Matteo): Make sure that the counters of the calling thread are open
+    (void)perfBegin();
+    perf->available = g_perf_available;
+    return true;
+#else
+    (void)mem;
+    return false;
+#endif
+}
+
+void
+memResetPerf(MemArena *mem)
+{
+    MEM_ASSERT(mem);
+
+#if defined(MEM_ENABLE_PERF)
+    for (size_t op = 0; op < MEM_PERF_OP_COUNT; ++op)
+    {
+        MemPerfCounters *counters = mem->perf + op;
+        atomicStore(&counters->count, 0);
+        atomicStore(&counters->time_ns, 0);
+        atomicStore(&counters->page_faults, 0);
+        atomicStore(&counters->dtlb_misses, 0);
+        atomicStore(&counters->cycles, 0);
+    }
+#else
+    (void)mem;
+#endif
+}
+
+void
+memReleaseThreadPerf(void)
+{
+#if defined(MEM_ENABLE_PERF)
+    if (g_perf_open)
+    {
+        perfClose(g_perf_fds);
+        g_perf_available = 0;
+        g_perf_open = false;
+    }
+#endif
+}
+
+//=== Tracing ===//
+
+enum
+{
+    // NOTE (Matteo): Upper bound of the length of a single event in the exported JSON
+    TRACE_EVENT_MAX_LEN = 256,
+};
+
+bool
+memTraceInit(MemTrace *trace, MemArena *mem, size_t capacity)
+{
+    MEM_ASSERT(trace && mem && capacity);
+
+    size_t cap = (size_t)1 << highBit(capacity);
+    if (cap < capacity) cap <<= 1;
+
+    MemBlock block = memAlloc(mem, cap * sizeof(MemTraceEvent), MEM_ALIGNOF(MemTraceEvent));
+    *trace = (MemTrace){.events = (MemTraceEvent *)block.ptr, .cap = block.ptr ? cap : 0};
+
+    return block.ptr != NULL;
+}
+
+void
+memSetTrace(MemArena *mem, MemTrace *trace)
+{
+    MEM_ASSERT(mem);
+    MEM_ASSERT(!trace || (trace->events && trace->cap));
+    // NOTE (Matteo): The trace would be recorded by other processes too
+    MEM_ASSERT(!(mem->flags & MEM_FLAG_SHARED));
+
+    mem->trace = trace;
+    updateFastCap(mem);
+}
+
+MemBlock
+memTraceExport(MemTrace *trace, MemArena *dst)
+{
+    MEM_ASSERT(trace && dst);
+
+    static char const *const names[] = {"", "alloc", "resize", "clear", "commit", "decommit"};
+
+    size_t end = atomicLoad(&trace->next);
+    size_t begin = end > trace->cap ? end - trace->cap : 0;
+
+    // NOTE (Matteo): The JSON is rendered in a buffer sized for the worst case, which is shrunk
+    // afterwards
+    size_t max_len = TRACE_EVENT_MAX_LEN * (end - begin + 1);
+    MemBlock block = memAllocUninit(dst, max_len, 1);
+    if (!block.ptr) return block;
+
+    char *out = (char *)block.ptr;
+    int len = snprintf(out, max_len, "{\"traceEvents\":[");
+    char const *separator = "";
+
+    for (size_t seq = begin; seq < end; ++seq)
+    {
+        MemTraceEvent *slot = trace->events + (seq & (trace->cap - 1));
+
+        // NOTE (Matteo): Skip events being overwritten; the fence keeps the copy before the second
+        // check of the sequence number
+        if (atomicLoad(&slot->seq) != seq + 1) continue;
+        MemTraceEvent event = *slot;
+        atomicFenceAcquire();
+        if (atomicLoad(&slot->seq) != seq + 1) continue;
+
+        bool timed = (event.kind == MEM_TRACE_COMMIT || event.kind == MEM_TRACE_DECOMMIT);
+        char duration[48] = "\"s\":\"t\",";
+        if (timed)
+        {
+            snprintf(duration, sizeof(duration), "\"dur\":%llu.%03u,",
+                     (unsigned long long)(event.duration / 1000),
+                     (unsigned)(event.duration % 1000));
+        }
+
+        len += snprintf(out + len, max_len - (size_t)len,
+                        "%s{\"name\":\"%s\",\"cat\":\"mem\",\"ph\":\"%s\",\"ts\":%llu.%03u,%s"
+                        "\"pid\":0,\"tid\":0,\"args\":{\"offset\":%lld,\"size\":%llu,"
+                        "\"alignment\":%llu}}",
+                        separator, names[event.kind], timed ? "X" : "i",
+                        (unsigned long long)(event.time / 1000), (unsigned)(event.time % 1000),
+                        duration, (long long)event.offset, (unsigned long long)event.size,
+                        (unsigned long long)event.alignment);
+        separator = ",";
+    }
+
+    len += snprintf(out + len, max_len - (size_t)len, "]}");
+    MEM_ASSERT(len > 0 && (size_t)len < max_len);
+
+    // NOTE (Matteo): Keep the NUL terminator
+    bool resized = memResize(dst, &block, (size_t)len + 1);
+    MEM_ASSERT(resized || (dst->flags & MEM_FLAG_CONCURRENT));
+    (void)resized;
+
+    block.len = (size_t)len;
+    return block;
+}
+
+//=== Heap profiling ===//
+
+enum
+{
+    // NOTE (Matteo): Upper bound of the length of a single site in the exported profile
+    PROFILE_SITE_MAX_LEN = 20 * MEM_PROFILE_MAX_DEPTH + 128,
+};
+
+bool
+memProfileInit(MemProfile *profile, MemArena *mem, size_t period, size_t capacity)
+{
+    MEM_ASSERT(profile && mem && period && capacity);
+
+    size_t pow2_period = (size_t)1 << highBit(period);
+    if (pow2_period < period) pow2_period <<= 1;
+
+    // NOTE (Matteo): The site table is kept at most half full
+    size_t site_cap = (size_t)1 << highBit(2 * capacity);
+    if (site_cap < 2 * capacity) site_cap <<= 1;
+
+    *profile = (MemProfile){.period = pow2_period};
+
+    MemBlock sites =
+        memAlloc(mem, site_cap * sizeof(MemProfileSite), MEM_ALIGNOF(MemProfileSite));
+    MemBlock live =
+        memAlloc(mem, capacity * sizeof(MemProfileSample), MEM_ALIGNOF(MemProfileSample));
+    if (!sites.ptr || !live.ptr) return false;
+
+    profile->sites = (MemProfileSite *)sites.ptr;
+    profile->site_cap = site_cap;
+    profile->live = (MemProfileSample *)live.ptr;
+    profile->live_cap = capacity;
+
+    return true;
+}
+
+void
+memSetProfile(MemArena *mem, MemProfile *profile)
+{
+    MEM_ASSERT(mem);
+    MEM_ASSERT(!profile || (profile->sites && profile->live));
+    // NOTE (Matteo): The profile would be updated by other processes too
+    MEM_ASSERT(!(mem->flags & MEM_FLAG_SHARED));
+
+    // NOTE (Matteo): Live samples cannot be tracked anymore
+    if (mem->profile) profileRelease(mem, true);
+
+    mem->profile = profile;
+    updateFastCap(mem);
+}
+
+MemBlock
+memProfileExport(MemProfile *profile, MemArena *dst, MemProfileFormat format)
+{
+    MEM_ASSERT(profile && dst);
+
+    // NOTE (Matteo): The profile is rendered in a buffer sized for the worst case (the site table
+    // is at most half full), which is shrunk afterwards. The buffer is allocated before taking the
+    // lock, because the destination arena may be sampled by the same profile.
+    size_t max_len = PROFILE_SITE_MAX_LEN * (profile->site_cap / 2 + 1);
+    MemBlock block = memAllocUninit(dst, max_len, 1);
+    if (!block.ptr) return block;
+
+    spinLock(&profile->lock);
+
+    char *out = (char *)block.ptr;
+    int len = 0;
+
+    if (format == MEM_PROFILE_PPROF)
     {
-        // NOTE (Matteo): Unused memory is decommitted only for safety reasons, in order to trigger
-        // an error if is accessed.
-        if (mem->flags & MEM_FLAG_UNSAFE) min_commit = mem->commit;
-        // NOTE (Matteo): Freshly committed memory is cleared to zero by default; for consistency
-        // all memory that is not decommitted (e.g. due to mismatched alignment) is cleared too.
-        decommit((MemBlock){.ptr = mem->ptr + min_commit, .len = mem->commit - min_commit});
-        MEM_ZERO(mem->ptr + mem->len, min_commit - mem->len);
+        size_t live_count = 0, live_bytes = 0, total_count = 0, total_bytes = 0;
+
+        for (size_t i = 0; i < profile->site_cap; ++i)
+        {
+            live_count += profile->sites[i].live_count;
+            live_bytes += profile->sites[i].live_bytes;
+            total_count += profile->sites[i].total_count;
+            total_bytes += profile->sites[i].total_bytes;
+        }
+
+        // NOTE (Matteo): The values are already scaled, which the 'heapprofile' flavor conveys
+        len = snprintf(out, max_len, "heap profile: %llu: %llu [%llu: %llu] @ heapprofile\n",
+                       (unsigned long long)live_count, (unsigned long long)live_bytes,
+                       (unsigned long long)total_count, (unsigned long long)total_bytes);
+    }
+
+    for (size_t i = 0; i < profile->site_cap; ++i)
+    {
+        MemProfileSite *site = profile->sites + i;
+        if (!site->total_bytes) continue;
+
+        if (format == MEM_PROFILE_PPROF)
+        {
+            len += snprintf(out + len, max_len - (size_t)len, "%llu: %llu [%llu: %llu] @",
+                            (unsigned long long)site->live_count,
+                            (unsigned long long)site->live_bytes,
+                            (unsigned long long)site->total_count,
+                            (unsigned long long)site->total_bytes);
+
+            for (uint32_t frame = 0; frame < site->depth; ++frame)
+            {
+                len += snprintf(out + len, max_len - (size_t)len, " 0x%llx",
+                                (unsigned long long)(size_t)site->frames[frame]);
+            }
+
+            len += snprintf(out + len, max_len - (size_t)len, "\n");
+        }
+        else
+        {
+            size_t bytes =
+                (format == MEM_PROFILE_FOLDED_LIVE) ? site->live_bytes : site->total_bytes;
+            if (!bytes) continue;
+
+            // NOTE (Matteo): Folded stacks start from the outermost frame
+            char const *separator = "";
+            for (uint32_t frame = site->depth; frame > 0; --frame)
+            {
+                len += snprintf(out + len, max_len - (size_t)len, "%s0x%llx", separator,
+                                (unsigned long long)(size_t)site->frames[frame - 1]);
+                separator = ";";
+            }
+
+            len += snprintf(out + len, max_len - (size_t)len, "%s %llu\n",
+                            site->depth ? "" : "[unknown]", (unsigned long long)bytes);
+        }
+    }
+
+    spinUnlock(&profile->lock);
+
+    if (format == MEM_PROFILE_PPROF)
+    {
+        int fd = openMaps();
+        if (fd >= 0)
+        {
+            len += snprintf(out + len, max_len - (size_t)len, "\nMAPPED_LIBRARIES:\n");
+
+            // NOTE (Matteo): The size of the map is not known in advance, so the block grows one
+            // page at a time; this may fail for concurrent arenas, truncating the map
+            for (;;)
+            {
+                size_t next_len = (size_t)len + dst->page_size + 1;
+                if (next_len > block.len && !memResizeUninit(dst, &block, next_len)) break;
+
+                out = (char *)block.ptr;
+                ptrdiff_t read_len = readFile(fd, out + len, dst->page_size);
+                if (read_len <= 0) break;
+                len += (int)read_len;
+            }
+
+            closeFile(fd);
+            out[len] = 0;
+        }
+    }
+
+    MEM_ASSERT(len >= 0 && (size_t)len < block.len);
+
+    // NOTE (Matteo): Keep the NUL terminator
+    bool resized = memResize(dst, &block, (size_t)len + 1);
+    MEM_ASSERT(resized || (dst->flags & MEM_FLAG_CONCURRENT));
+    (void)resized;
+
+    block.len = (size_t)len;
+    return block;
+}
+
+//=== Arena registry ===//
+
+size_t
+memForEachArena(MemArenaVisitor visitor, void *context)
+{
+    MEM_ASSERT(visitor);
+
+    size_t count = 0;
+
+    spinLock(&g_registry_lock);
+
+    for (MemArena *mem = g_registry; mem; mem = mem->registry_next)
+    {
+        MemArenaReport report = {
+            .arena = mem,
+            .name = mem->name,
+            .tag = mem->tag,
+            .reserved = mem->reserved,
+            .committed = commitLen(mem),
+            .used = mem->base_pos + atomicLoad(&mem->len) + mem->back_len,
+        };
+
+#if defined(MEM_ENABLE_STATS)
+        report.peak = atomicLoad(&mem->stats.peak_commit);
+        if (report.peak < report.committed) report.peak = report.committed;
+#endif
+
+        visitor(&report, context);
+        ++count;
+    }
+
+    spinUnlock(&g_registry_lock);
+
+    return count;
+}
+
+typedef struct ArenaDump
+{
+    FILE *stream;
+    MemArenaReport total;
+} ArenaDump;
+
+static void
+dumpArena(MemArenaReport const *report, void *context)
+{
+    ArenaDump *dump = context;
+
+    // NOTE (Matteo): The peak is not available without statistics
+    char peak[24] = "-";
+#if defined(MEM_ENABLE_STATS)
+    snprintf(peak, sizeof(peak), "%llu", (unsigned long long)report->peak);
+#endif
+
+    fprintf(dump->stream, "%-31s %10u %14llu %14llu %14llu %14s\n", report->name, report->tag,
+            (unsigned long long)report->reserved, (unsigned long long)report->committed,
+            (unsigned long long)report->used, peak);
+
+    dump->total.reserved += report->reserved;
+    dump->total.committed += report->committed;
+    dump->total.used += report->used;
+    dump->total.peak += report->peak;
+}
+
+void
+memDumpArenas(FILE *stream)
+{
+    MEM_ASSERT(stream);
+
+    fprintf(stream, "%-31s %10s %14s %14s %14s %14s\n", "name", "tag", "reserved", "committed",
+            "used", "peak");
+
+    ArenaDump dump = {.stream = stream};
+    size_t count = memForEachArena(dumpArena, &dump);
+
+    // NOTE (Matteo): The sum of the peaks is an upper bound of the overall peak
+    char peak[24] = "-";
+#if defined(MEM_ENABLE_STATS)
+    snprintf(peak, sizeof(peak), "%llu", (unsigned long long)dump.total.peak);
+#endif
+
+    char label[MEM_ARENA_NAME_LEN];
+    snprintf(label, sizeof(label), "total (%llu arenas)", (unsigned long long)count);
+
+    fprintf(stream, "%-31s %10s %14llu %14llu %14llu %14s\n", label, "",
+            (unsigned long long)dump.total.reserved, (unsigned long long)dump.total.committed,
+            (unsigned long long)dump.total.used, peak);
+}
+
+//=== Fork/join ===//
+
+MemArena *
+memFork(MemArena *parent, size_t size)
+{
+    MEM_ASSERT(parent);
+
+    // NOTE (Matteo): The child range is page aligned so that commit operations on either arena do
+    // not interfere with each other
+    size_t page_size = parent->page_size;
+    uint8_t *base = (uint8_t *)alignForward((size_t)(parent->ptr + parent->len), page_size);
+    uint8_t *end = (uint8_t *)alignForward((size_t)base + sizeof(MemArena) + size, page_size);
+    // NOTE (Matteo): The child range cannot overlap the pages committed for the back end
+    uint8_t *parent_end = parent->ptr + backEnd(parent) - parent->back_commit;
+    if (end > parent_end || end < base) return NULL;
+
+    // NOTE (Matteo): The parent may have already committed part of the child range; the first page
+    // is required anyway to store the child data structure
+    uint8_t *commit_end = parent->ptr + parent->commit;
+    if (commit_end < base + page_size)
+    {
+        commitArena(parent,
+                    (MemBlock){.ptr = commit_end, .len = (size_t)(base + page_size - commit_end)});
+        commit_end = base + page_size;
+    }
+    if (commit_end > end) commit_end = end;
+
+    MEM_ZERO(base, sizeof(MemArena));
+
+    MemArena *child = (MemArena *)base;
+    child->ptr = base + alignForward(sizeof(MemArena), 16);
+    child->cap = (size_t)(end - child->ptr);
+    child->commit = (size_t)(commit_end - child->ptr);
+    child->page_size = page_size;
+    child->commit_size = parent->commit_size;
+    child->decommit_threshold = parent->decommit_threshold;
+    child->parent = parent;
+    child->flags = parent->flags & ~(uint32_t)(MEM_FLAG_CONCURRENT | MEM_FLAG_CHAINED);
+
+    // NOTE (Matteo): Released memory of the parent may be dirty
+    uint8_t *dirty_end = parent->ptr + parent->dirty;
+    if (dirty_end > child->ptr) child->dirty = (size_t)(dirty_end - child->ptr);
+
+    // NOTE (Matteo): The parent regards the whole child range as committed, because it is not
+    // allowed to touch it until the child is joined
+    parent->len = (size_t)(end - parent->ptr);
+    if (parent->commit < parent->len) parent->commit = parent->len;
+
+    updateFastCap(child);
+    updateFastCap(parent);
+
+    return child;
+}
+
+void
+memJoin(MemArena *child, bool discard)
+{
+    MEM_ASSERT(child && child->parent);
+
+    if (child->profile) profileRelease(child, true);
+
+    MemArena *parent = child->parent;
+    uint8_t *base = (uint8_t *)child;
+    uint8_t *end = child->ptr + child->cap;
+    uint8_t *used_end = discard ? base : child->ptr + child->len;
+    uint8_t *commit_end = child->ptr + child->commit;
+    // NOTE (Matteo): Memory past this point is clear
+    uint8_t *dirty_end = child->ptr + (child->dirty > child->len ? child->dirty : child->len);
+
+    if (parent->ptr + parent->len == end)
+    {
+        // NOTE (Matteo): The child is the last allocation, so its unused range is given back to the
+        // parent, which must regard the uncommitted part of the range as such
+        if (parent->ptr + parent->commit > end)
+        {
+            commitArena(parent, (MemBlock){.ptr = commit_end, .len = (size_t)(end - commit_end)});
+        }
+        else
+        {
+            parent->commit = (size_t)(commit_end - parent->ptr);
+        }
+
+        parent->len = (size_t)(used_end - parent->ptr);
+        adjustCommited(parent, (size_t)(dirty_end - parent->ptr));
+    }
+    else if (discard)
+    {
+        // NOTE (Matteo): The range is leaked, but its physical memory can be returned to the OS;
+        // the parent still regards it as committed
+        decommitArena(parent, (MemBlock){.ptr = base, .len = (size_t)(commit_end - base)});
+        commitArena(parent, (MemBlock){.ptr = base, .len = (size_t)(end - base)});
+    }
+    else
+    {
+        // NOTE (Matteo): The parent regards the whole range as committed
+        commitArena(parent, (MemBlock){.ptr = commit_end, .len = (size_t)(end - commit_end)});
+    }
+}
+
+//=== Pool allocator ===//
+
+void
+memPoolInit(MemPool *pool, MemArena *mem, size_t slot_size, size_t slot_alignment)
+{
+    MEM_ASSERT(pool && mem);
+    MEM_ASSERT(slot_size);
+
+    // NOTE (Matteo): Free slots must be able to store the free list link
+    if (slot_alignment < MEM_ALIGNOF(void *)) slot_alignment = MEM_ALIGNOF(void *);
+    if (slot_size < sizeof(void *)) slot_size = sizeof(void *);
+
+    *pool = (MemPool){
+        .mem = mem,
+        .slot_size = alignForward(slot_size, slot_alignment),
+        .slot_align = slot_alignment,
+    };
+}
+
+void *
+memPoolAlloc(MemPool *pool)
+{
+    MEM_ASSERT(pool && pool->mem);
+
+    uint8_t *slot = pool->free_list;
+
+    if (slot)
+    {
+        // NOTE (Matteo): Recycled slots are dirty
+        MEM_COPY(&pool->free_list, slot, sizeof(void *));
+        MEM_ZERO(slot, pool->slot_size);
+        return slot;
+    }
+
+    if (pool->batch_len < pool->slot_size)
+    {
+        // NOTE (Matteo): Slots are carved from page-sized batches, so that the arena (and its
+        // commit logic) is involved once per batch instead of once per slot
+        size_t page_size = pool->mem->page_size;
+        size_t batch_len = pool->slot_size;
+        if (batch_len < page_size) batch_len = page_size - page_size % pool->slot_size;
+
+        MemBlock batch = memAlloc(pool->mem, batch_len, pool->slot_align);
+        if (!batch.ptr) return NULL;
+
+        pool->batch_ptr = batch.ptr;
+        pool->batch_len = batch.len;
+    }
+
+    slot = pool->batch_ptr;
+    pool->batch_ptr += pool->slot_size;
+    pool->batch_len -= pool->slot_size;
+
+    return slot;
+}
+
+void
+memPoolFree(MemPool *pool, void *slot)
+{
+    MEM_ASSERT(pool);
+
+    if (slot)
+    {
+        MEM_COPY(slot, &pool->free_list, sizeof(void *));
+        pool->free_list = slot;
+    }
+}
+
+void
+memPoolReset(MemPool *pool)
+{
+    MEM_ASSERT(pool);
+
+    pool->free_list = NULL;
+    pool->batch_ptr = NULL;
+    pool->batch_len = 0;
+}
+
+//=== Slab allocator ===//
+
+_Static_assert(MEM_SLAB_CLASSES == 2 * (15 - 4) + 1, "Slab size classes mismatch");
+
+static inline size_t
+slabClassSize(size_t index)
+{
+    // NOTE (Matteo): Even classes are powers of 2, odd ones are 1.5 times the previous power
+    size_t power = (size_t)MEM_SLAB_MIN_SIZE << (index / 2);
+    return (index & 1) ? power + power / 2 : power;
+}
+
+static inline size_t
+slabClassIndex(size_t size)
+{
+    if (size <= MEM_SLAB_MIN_SIZE) return 0;
+
+    // NOTE (Matteo): 2^k < size <= 2^(k + 1), with k >= 4
+    uint32_t k = highBit(size - 1);
+    size_t half = ((size_t)3 << (k - 1));
+    return 2 * (size_t)(k - 4) + (size <= half ? 1 : 2);
+}
+
+bool
+memSlabInit(MemSlab *slab, MemArena *parent, size_t class_size)
+{
+    MEM_ASSERT(slab && parent);
+
+    *slab = (MemSlab){0};
+
+    for (size_t index = 0; index < MEM_SLAB_CLASSES; ++index)
+    {
+        MemArena *mem = memFork(parent, class_size);
+
+        if (!mem)
+        {
+            memSlabRelease(slab);
+            return false;
+        }
+
+        size_t size = slabClassSize(index);
+        size_t align = size & (~size + 1);
+        if (align > 16) align = 16;
+
+        memPoolInit(&slab->pools[index], mem, size, align);
+    }
+
+    // NOTE (Matteo): Forked ranges are contiguous and evenly sized
+    slab->base = (uint8_t *)slab->pools[0].mem;
+    slab->run_size = (size_t)((uint8_t *)slab->pools[1].mem - slab->base);
+
+    return true;
+}
+
+void
+memSlabRelease(MemSlab *slab)
+{
+    MEM_ASSERT(slab);
+
+    // NOTE (Matteo): Joining in reverse order gives the whole range back to the parent
+    for (size_t index = MEM_SLAB_CLASSES; index > 0; --index)
+    {
+        MemPool *pool = &slab->pools[index - 1];
+        if (pool->mem) memJoin(pool->mem, true);
+    }
+
+    *slab = (MemSlab){0};
+}
+
+void
+memSlabReset(MemSlab *slab)
+{
+    MEM_ASSERT(slab);
+
+    for (size_t index = 0; index < MEM_SLAB_CLASSES; ++index)
+    {
+        memClear(slab->pools[index].mem);
+        memPoolReset(&slab->pools[index]);
+    }
+}
+
+void *
+memSlabAlloc(MemSlab *slab, size_t size)
+{
+    MEM_ASSERT(slab);
+
+    if (!size || size > MEM_SLAB_MAX_SIZE) return NULL;
+
+    return memPoolAlloc(&slab->pools[slabClassIndex(size)]);
+}
+
+void
+memSlabFree(MemSlab *slab, void *ptr)
+{
+    MEM_ASSERT(slab);
+
+    if (!ptr) return;
+
+    size_t index = (size_t)((uint8_t *)ptr - slab->base) / slab->run_size;
+    MEM_ASSERT(index < MEM_SLAB_CLASSES);
+
+    memPoolFree(&slab->pools[index], ptr);
+}
+
+//=== TLSF allocator ===//
+
+// NOTE (Matteo): Blocks are laid out contiguously in the region, each one starting with a header;
+// the size includes the header and is a multiple of the alignment, so the low bits are used as
+// flags. Free blocks store the free list links in their payload. The region ends with a sentinel
+// header of size 0, marked as used.
+struct MemTlsfBlock
+{
+    MemTlsfBlock *prev_phys;
+    size_t size;
+    MemTlsfBlock *next_free, *prev_free;
+};
+
+enum
+{
+    TLSF_ALIGN = 16,
+    TLSF_HEADER = 16,
+    TLSF_MIN_BLOCK = 32,
+
+    TLSF_SL_LOG2 = 4,
+    TLSF_FL_SHIFT = TLSF_SL_LOG2 + 4,
+    TLSF_SMALL_BLOCK = 1 << TLSF_FL_SHIFT,
+
+    TLSF_FREE = 0x1,
+    // NOTE (Matteo): Part of the block memory may be decommitted, and must be committed before use
+    TLSF_DECOMMITTED = 0x2,
+    TLSF_FLAGS = TLSF_ALIGN - 1,
+};
+
+_Static_assert(offsetof(MemTlsfBlock, next_free) <= TLSF_HEADER, "TLSF header too large");
+_Static_assert(sizeof(MemTlsfBlock) <= TLSF_MIN_BLOCK, "TLSF block too large");
+_Static_assert(MEM_TLSF_SL_COUNT == 1 << TLSF_SL_LOG2, "TLSF second level mismatch");
+
+static inline size_t
+tlsfSize(MemTlsfBlock const *block)
+{
+    return block->size & ~(size_t)TLSF_FLAGS;
+}
+
+static inline MemTlsfBlock *
+tlsfNext(MemTlsfBlock *block)
+{
+    return (MemTlsfBlock *)((uint8_t *)block + tlsfSize(block));
+}
+
+static inline bool
+tlsfMapping(size_t size, uint32_t *fl, uint32_t *sl)
+{
+    if (size < TLSF_SMALL_BLOCK)
+    {
+        *fl = 0;
+        *sl = (uint32_t)(size / (TLSF_SMALL_BLOCK / MEM_TLSF_SL_COUNT));
+    }
+    else
+    {
+        uint32_t bit = highBit(size);
+        *sl = (uint32_t)(size >> (bit - TLSF_SL_LOG2)) ^ MEM_TLSF_SL_COUNT;
+        *fl = bit - (TLSF_FL_SHIFT - 1);
+    }
+
+    return *fl < MEM_TLSF_FL_COUNT;
+}
+
+static void
+tlsfInsert(MemTlsf *tlsf, MemTlsfBlock *block)
+{
+    uint32_t fl, sl;
+    bool mapped = tlsfMapping(tlsfSize(block), &fl, &sl);
+    MEM_ASSERT(mapped);
+    (void)mapped;
+
+    MemTlsfBlock *head = tlsf->blocks[fl][sl];
+    block->next_free = head;
+    block->prev_free = NULL;
+    if (head) head->prev_free = block;
+
+    tlsf->blocks[fl][sl] = block;
+    tlsf->fl_bitmap |= (1u << fl);
+    tlsf->sl_bitmap[fl] |= (1u << sl);
+}
+
+static void
+tlsfRemove(MemTlsf *tlsf, MemTlsfBlock *block)
+{
+    uint32_t fl, sl;
+    tlsfMapping(tlsfSize(block), &fl, &sl);
+
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+
+    if (block->prev_free)
+    {
+        block->prev_free->next_free = block->next_free;
+    }
+    else
+    {
+        tlsf->blocks[fl][sl] = block->next_free;
+
+        if (!block->next_free)
+        {
+            tlsf->sl_bitmap[fl] &= ~(1u << sl);
+            if (!tlsf->sl_bitmap[fl]) tlsf->fl_bitmap &= ~(1u << fl);
+        }
+    }
+}
+
+static MemTlsfBlock *
+tlsfFind(MemTlsf *tlsf, size_t size)
+{
+    // NOTE (Matteo): Round up to the next size class, so that any block in the list fits
+    if (size >= TLSF_SMALL_BLOCK)
+    {
+        size_t round = ((size_t)1 << (highBit(size) - TLSF_SL_LOG2)) - 1;
+        if (size + round < size) return NULL;
+        size += round;
     }
-    else if (min_commit > mem->commit)
+
+    uint32_t fl, sl;
+    if (!tlsfMapping(size, &fl, &sl)) return NULL;
+
+    uint32_t sl_map = tlsf->sl_bitmap[fl] & (~0u << sl);
+
+    if (!sl_map)
     {
-        commit((MemBlock){.ptr = mem->ptr + mem->commit, .len = min_commit - mem->commit});
+        uint32_t fl_map = (fl + 1 < MEM_TLSF_FL_COUNT) ? tlsf->fl_bitmap & (~0u << (fl + 1)) : 0;
+        if (!fl_map) return NULL;
+
+        fl = lowBit(fl_map);
+        sl_map = tlsf->sl_bitmap[fl];
     }
 
-    mem->commit = min_commit;
+    return tlsf->blocks[fl][lowBit(sl_map)];
 }
 
-//=== Interface functions ===//
+// Commit the decommitted memory of a free block in the given range
+static void
+tlsfCommit(MemTlsf *tlsf, MemTlsfBlock *block, size_t len)
+{
+    if (!(block->size & TLSF_DECOMMITTED)) return;
 
-void
-memRelease(MemArena *mem)
+    size_t page_size = tlsf->mem->page_size;
+    uint8_t *start = (uint8_t *)alignForward((size_t)block + TLSF_MIN_BLOCK, page_size);
+    uint8_t *end = (uint8_t *)alignForward((size_t)block + len, page_size);
+    uint8_t *block_end = (uint8_t *)block + tlsfSize(block);
+
+    if (end > block_end) end = (uint8_t *)alignBackward((size_t)block_end, page_size);
+    if (end > start)
+    {
+        commitArena(tlsf->mem, (MemBlock){.ptr = start, .len = (size_t)(end - start)});
+    }
+}
+
+// Decommit the memory of a free block, except for the header and free list links
+static void
+tlsfDecommit(MemTlsf *tlsf, MemTlsfBlock *block)
 {
-    MEM_ASSERT(mem);
-    decommit((MemBlock){.ptr = mem->ptr, .len = mem->commit});
-    BOOL result = VirtualFree(mem, 0, MEM_RELEASE);
-    MEM_ASSERT(result);
+    size_t page_size = tlsf->mem->page_size;
+    uint8_t *start = (uint8_t *)alignForward((size_t)block + TLSF_MIN_BLOCK, page_size);
+    uint8_t *end = (uint8_t *)alignBackward((size_t)block + tlsfSize(block), page_size);
+
+    if (end > start)
+    {
+        decommitArena(tlsf->mem, (MemBlock){.ptr = start, .len = (size_t)(end - start)});
+        block->size |= TLSF_DECOMMITTED;
+    }
 }
 
-MemArena *
-memReserve(MemArenaInfo const *info)
+// Mark a free block as used, giving back the excess memory
+static void
+tlsfUse(MemTlsf *tlsf, MemTlsfBlock *block, size_t size)
 {
-    // NOTE (Matteo): A single page is committed to store the allocator data structure. This is
-    // a bit wasteful, but allows memory protection to work for all subsequent allocations
-    MemBlock block = {.len = MEM_PAGE_SIZE};
+    size_t block_size = tlsfSize(block);
+    MEM_ASSERT(block_size >= size);
 
-    // NOTE (Matteo): If the total allocation size is not provided, it is deduced from the required
-    // available size, plus the space required to store the allocator data structure
-    size_t total_size = info->total_size;
-    size_t avail_size = info->available_size;
+    // NOTE (Matteo): The header of the remainder must be committed too
+    bool split = (block_size - size >= TLSF_MIN_BLOCK);
+    tlsfCommit(tlsf, block, split ? size + TLSF_MIN_BLOCK : block_size);
 
-    if (!total_size)
+    if (split)
     {
-        MEM_ASSERT(avail_size);
-        total_size = avail_size + block.len;
+        MemTlsfBlock *rest = (MemTlsfBlock *)((uint8_t *)block + size);
+        rest->size = (block_size - size) | TLSF_FREE | (block->size & TLSF_DECOMMITTED);
+        rest->prev_phys = block;
+        tlsfNext(rest)->prev_phys = rest;
+        tlsfInsert(tlsf, rest);
+        block_size = size;
     }
 
-    if (!avail_size)
+    block->size = block_size;
+}
+
+// Merge a free block with its free neighbors (which are removed from the free lists)
+static MemTlsfBlock *
+tlsfMerge(MemTlsf *tlsf, MemTlsfBlock *block)
+{
+    MemTlsfBlock *prev = block->prev_phys;
+
+    if (prev && (prev->size & TLSF_FREE))
     {
-        MEM_ASSERT(total_size);
-        avail_size = total_size - block.len;
+        tlsfRemove(tlsf, prev);
+        prev->size += tlsfSize(block);
+        prev->size |= (block->size & TLSF_DECOMMITTED);
+        block = prev;
     }
 
-    // NOTE (Matteo): Reserve a block of virtual memory from the OS and keep it protected, except
-    // for the space used to store the allocator data structure
-    block.ptr = VirtualAlloc(NULL, total_size, MEM_RESERVE, PAGE_NOACCESS);
-    if (!block.ptr) return NULL;
+    MemTlsfBlock *next = tlsfNext(block);
 
-    MEM_ASSERT(sizeof(MemArena) <= MEM_PAGE_SIZE);
-    block.len = MEM_PAGE_SIZE;
-    commit(block);
+    if (next->size & TLSF_FREE)
+    {
+        tlsfRemove(tlsf, next);
+        block->size += tlsfSize(next);
+        block->size |= (next->size & TLSF_DECOMMITTED);
+    }
 
-    MemArena *mem = (MemArena *)block.ptr;
-    mem->ptr = block.ptr + MEM_PAGE_SIZE;
-    mem->cap = avail_size;
-    mem->len = 0;
-    mem->commit = 0;
-    mem->flags |= (MEM_FLAG_UNSAFE & boolMask(info->unsafe));
+    tlsfNext(block)->prev_phys = block;
+    return block;
+}
 
-    return mem;
+// Release a free block, which is merged with its neighbors and given back to the arena if at the
+// end of the region, or decommitted if large enough
+static void
+tlsfRelease(MemTlsf *tlsf, MemTlsfBlock *block)
+{
+    block->size |= TLSF_FREE;
+    block = tlsfMerge(tlsf, block);
+
+    size_t size = tlsfSize(block);
+    MemTlsfBlock *next = tlsfNext(block);
+
+    if (size >= tlsf->decommit_size && !tlsfSize(next))
+    {
+        // NOTE (Matteo): The block becomes the new sentinel, and the arena decommit policy applies
+        // to the memory given back
+        bool decommitted = (block->size & TLSF_DECOMMITTED);
+        block->size = 0;
+
+        size_t region_len = (size_t)((uint8_t *)block - tlsf->region.ptr) + TLSF_HEADER;
+        bool resized = memResizeUninit(tlsf->mem, &tlsf->region, region_len);
+        MEM_ASSERT(resized);
+        (void)resized;
+
+        // NOTE (Matteo): The arena may keep some of the memory committed, but it must not contain
+        // decommitted pages
+        if (decommitted) memTrim(tlsf->mem, 0);
+        return;
+    }
+
+    if (size >= tlsf->decommit_size) tlsfDecommit(tlsf, block);
+    tlsfInsert(tlsf, block);
 }
 
-void
-memClear(MemArena *mem)
+// Grow the region in order to fit a block of the given size, returning the resulting free block
+static MemTlsfBlock *
+tlsfGrow(MemTlsf *tlsf, size_t size)
 {
-    MEM_ASSERT(mem);
-    mem->len = 0;
-    adjustCommited(mem);
+    size_t grow = size > tlsf->grow_size ? size : tlsf->grow_size;
+    if (grow > memAvailable(tlsf->mem)) grow = size;
+
+    if (!memResizeUninit(tlsf->mem, &tlsf->region, tlsf->region.len + grow)) return NULL;
+
+    // NOTE (Matteo): The old sentinel becomes the header of the new free block
+    uint8_t *sentinel_ptr = tlsf->region.ptr + tlsf->region.len - TLSF_HEADER;
+    MemTlsfBlock *block = (MemTlsfBlock *)(sentinel_ptr - grow);
+    block->size = grow;
+
+    MemTlsfBlock *sentinel = tlsfNext(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+
+    block->size |= TLSF_FREE;
+    block = tlsfMerge(tlsf, block);
+    tlsfInsert(tlsf, block);
+
+    return block;
 }
 
-MemBlock
-memAlloc(MemArena *mem, size_t len, size_t alignment)
+bool
+memTlsfInit(MemTlsf *tlsf, MemArenaInfo const *info)
 {
-    MEM_ASSERT(mem);
+    MEM_ASSERT(tlsf && info);
 
-    MemBlock block = {
-        .ptr = (uint8_t *)alignForward((size_t)(mem->ptr + mem->len), alignment),
-    };
+    MemArenaInfo arena_info = *info;
+    arena_info.no_zero = true;
+    arena_info.concurrent = false;
+    arena_info.chained = false;
 
-    size_t next_len = len + (block.ptr - mem->ptr);
-    if (next_len > mem->cap || len == 0)
-    {
-        block.ptr = NULL;
-    }
-    else
+    *tlsf = (MemTlsf){0};
+
+    tlsf->mem = memReserve(&arena_info);
+    if (!tlsf->mem) return false;
+
+    tlsf->region = memAllocUninit(tlsf->mem, TLSF_HEADER, TLSF_ALIGN);
+    if (!tlsf->region.ptr)
     {
-        block.len = len;
-        mem->len = next_len;
-        adjustCommited(mem);
-        // NOTE (Matteo): Memory must be always cleared to 0
-        MEM_ASSERT(block.ptr[0] == 0);
+        memRelease(tlsf->mem);
+        tlsf->mem = NULL;
+        return false;
     }
 
-    return block;
+    MemTlsfBlock *sentinel = (MemTlsfBlock *)tlsf->region.ptr;
+    sentinel->prev_phys = NULL;
+    sentinel->size = 0;
+
+    size_t page_size = tlsf->mem->page_size;
+    tlsf->grow_size = alignForward(tlsf->mem->commit_size, TLSF_ALIGN);
+    tlsf->decommit_size = info->decommit_threshold ? info->decommit_threshold : MEM_KB(256);
+    if (tlsf->decommit_size < 2 * page_size) tlsf->decommit_size = 2 * page_size;
+
+    return true;
 }
 
-bool
-memResize(MemArena *mem, MemBlock *block, size_t new_len)
+void
+memTlsfRelease(MemTlsf *tlsf)
 {
-    MEM_ASSERT(mem);
+    MEM_ASSERT(tlsf);
+    if (tlsf->mem) memRelease(tlsf->mem);
+    *tlsf = (MemTlsf){0};
+}
 
-    if (!lastAlloc(mem, block)) return false;
+void *
+memTlsfAlloc(MemTlsf *tlsf, size_t size)
+{
+    MEM_ASSERT(tlsf && tlsf->mem);
 
-    if (new_len < block->len)
+    if (!size) return NULL;
+
+    size_t block_size = alignForward(size + TLSF_HEADER, TLSF_ALIGN);
+    if (block_size < size) return NULL;
+    if (block_size < TLSF_MIN_BLOCK) block_size = TLSF_MIN_BLOCK;
+
+    // NOTE (Matteo): The grown block is used directly, since it fits the required size even if it
+    // may belong to a smaller size class than the one searched
+    MemTlsfBlock *block = tlsfFind(tlsf, block_size);
+    if (!block) block = tlsfGrow(tlsf, block_size);
+    if (!block) return NULL;
+
+    tlsfRemove(tlsf, block);
+    tlsfUse(tlsf, block, block_size);
+
+    return (uint8_t *)block + TLSF_HEADER;
+}
+
+void
+memTlsfFree(MemTlsf *tlsf, void *ptr)
+{
+    MEM_ASSERT(tlsf);
+
+    if (!ptr) return;
+
+    MemTlsfBlock *block = (MemTlsfBlock *)((uint8_t *)ptr - TLSF_HEADER);
+    MEM_ASSERT(!(block->size & TLSF_FREE));
+
+    tlsfRelease(tlsf, block);
+}
+
+void *
+memTlsfRealloc(MemTlsf *tlsf, void *ptr, size_t size)
+{
+    MEM_ASSERT(tlsf);
+
+    if (!ptr) return memTlsfAlloc(tlsf, size);
+
+    if (!size)
     {
-        mem->len -= (block->len - new_len);
-        adjustCommited(mem);
+        memTlsfFree(tlsf, ptr);
+        return NULL;
     }
-    else
+
+    MemTlsfBlock *block = (MemTlsfBlock *)((uint8_t *)ptr - TLSF_HEADER);
+    size_t curr_size = tlsfSize(block);
+
+    size_t block_size = alignForward(size + TLSF_HEADER, TLSF_ALIGN);
+    if (block_size < size) return NULL;
+    if (block_size < TLSF_MIN_BLOCK) block_size = TLSF_MIN_BLOCK;
+
+    if (block_size <= curr_size)
     {
-        size_t request = new_len - block->len;
-        if (request > memAvailable(mem)) return false;
-        mem->len += request;
-        adjustCommited(mem);
+        // NOTE (Matteo): Shrink in place, giving back the excess memory if large enough
+        if (curr_size - block_size >= TLSF_MIN_BLOCK)
+        {
+            MemTlsfBlock *rest = (MemTlsfBlock *)((uint8_t *)block + block_size);
+            rest->size = curr_size - block_size;
+            rest->prev_phys = block;
+            tlsfNext(rest)->prev_phys = rest;
+            block->size = block_size;
+            tlsfRelease(tlsf, rest);
+        }
+
+        return ptr;
     }
 
-    if (!new_len)
+    // NOTE (Matteo): Grow in place by absorbing the next block, if free and large enough
+    MemTlsfBlock *next = tlsfNext(block);
+    if ((next->size & TLSF_FREE) && curr_size + tlsfSize(next) >= block_size)
     {
-        // NOTE (Matteo): Empty blocks are not accessible
-        block->ptr = NULL;
+        tlsfRemove(tlsf, next);
+        block->size = (curr_size + tlsfSize(next)) | TLSF_FREE | (next->size & TLSF_DECOMMITTED);
+        tlsfNext(block)->prev_phys = block;
+        tlsfUse(tlsf, block, block_size);
+        return ptr;
     }
-    else
+
+    void *result = memTlsfAlloc(tlsf, size);
+    if (result)
     {
-        // NOTE (Matteo): Memory must be always cleared to 0
-        MEM_ASSERT(block->ptr[0] == 0);
+        MEM_COPY(result, ptr, curr_size - TLSF_HEADER);
+        memTlsfFree(tlsf, ptr);
     }
 
-    block->len = new_len;
+    return result;
+}
+
+//=== Scratch arenas ===//
+
+static MEM_THREAD_LOCAL MemArena *g_scratch[MEM_SCRATCH_COUNT];
+
+MemScratch
+memGetScratch(MemArena *const *conflicts, size_t count)
+{
+    MEM_ASSERT(conflicts || !count);
+
+    for (size_t index = 0; index < MEM_SCRATCH_COUNT; ++index)
+    {
+        MemArena *mem = g_scratch[index];
+
+        if (mem)
+        {
+            bool conflict = false;
+            for (size_t i = 0; i < count && !conflict; ++i) conflict = (conflicts[i] == mem);
+            if (conflict) continue;
+        }
+        else
+        {
+            // NOTE (Matteo): Scratch memory is reused heavily, so it is committed in large chunks
+            // and some slack is kept around to avoid a syscall per scope
+            mem = memReserve(&(MemArenaInfo){
+                .total_size = MEM_SCRATCH_SIZE,
+                .commit_size = MEM_KB(64),
+                .decommit_threshold = MEM_MB(1),
+            });
+            if (!mem) break;
+            g_scratch[index] = mem;
+        }
+
+        return (MemScratch){.mem = mem, .mark = memSave(mem)};
+    }
+
+    return (MemScratch){0};
+}
+
+void
+memReleaseScratch(MemScratch scratch)
+{
+    if (scratch.mem) memRestore(scratch.mem, scratch.mark);
+}
+
+void
+memReleaseThreadScratch(void)
+{
+    for (size_t index = 0; index < MEM_SCRATCH_COUNT; ++index)
+    {
+        if (g_scratch[index])
+        {
+            memRelease(g_scratch[index]);
+            g_scratch[index] = NULL;
+        }
+    }
+}
+
+//=== Ring buffer ===//
+
+// NOTE (Matteo): Cursors wrap around at twice the capacity, rather than on integer overflow, so
+// that a full buffer can be told apart from an empty one without requiring a power of 2 capacity
+
+static inline size_t
+ringOffset(MemRing *ring, size_t cursor)
+{
+    return cursor < ring->cap ? cursor : cursor - ring->cap;
+}
+
+static inline size_t
+ringDistance(MemRing *ring, size_t from, size_t to)
+{
+    size_t distance = to >= from ? to - from : to + 2 * ring->cap - from;
+    MEM_ASSERT(distance <= ring->cap);
+    return distance;
+}
+
+static inline size_t
+ringAdvance(MemRing *ring, size_t cursor, size_t len)
+{
+    size_t result = cursor + len;
+    return result < 2 * ring->cap ? result : result - 2 * ring->cap;
+}
+
+bool
+memRingInit(MemRing *ring, size_t min_cap)
+{
+    MEM_ASSERT(ring && !ring->ptr);
+
+    size_t cap = alignForward(min_cap ? min_cap : 1, ringGranularity());
+    uint8_t *ptr = mapRing(cap);
+    if (!ptr) return false;
+
+    *ring = (MemRing){.ptr = ptr, .cap = cap};
     return true;
 }
 
-size_t
-memAvailable(MemArena *mem)
+void
+memRingRelease(MemRing *ring)
 {
-    MEM_ASSERT(mem);
-    return mem->cap - mem->len;
+    if (ring->ptr) unmapRing(ring->ptr, ring->cap);
+    *ring = (MemRing){0};
 }
 
-void *
-memReallocBufEx(MemArena *mem, MemBufInfo const *info)
+MemBlock
+memRingBeginWrite(MemRing *ring)
 {
-    MEM_ASSERT(mem);
-    MEM_ASSERT(info);
-    MEM_ASSERT(info->curr_cap_ptr);
+    // NOTE (Matteo): The head is owned by the producer, so it does not require an atomic load
+    size_t head = ring->head;
+    size_t used = ringDistance(ring, atomicLoad(&ring->tail), head);
+    return (MemBlock){.ptr = ring->ptr + ringOffset(ring, head), .len = ring->cap - used};
+}
 
-    size_t target_cap = info->required_cap;
-    size_t curr_cap = *info->curr_cap_ptr;
+void
+memRingEndWrite(MemRing *ring, size_t len)
+{
+    size_t head = ring->head;
+    MEM_ASSERT(len <= ring->cap - ringDistance(ring, atomicLoad(&ring->tail), head));
+    atomicStore(&ring->head, ringAdvance(ring, head, len));
+}
 
-    // NOTE (Matteo): Exit early if possible
-    if (target_cap == curr_cap) return info->curr_buf;
+MemBlock
+memRingBeginRead(MemRing *ring)
+{
+    // NOTE (Matteo): The tail is owned by the consumer, so it does not require an atomic load
+    size_t tail = ring->tail;
+    size_t used = ringDistance(ring, tail, atomicLoad(&ring->head));
+    return (MemBlock){.ptr = ring->ptr + ringOffset(ring, tail), .len = used};
+}
 
-    if (!info->strict_cap)
-    {
-        // TODO (Matteo): Is this a real case?
-        // NOTE (Matteo): In case a stricly lower capacity is required, we honor
-        // it by reallocating; otherwise we can leave it as is.
-        if (target_cap < curr_cap) return info->curr_buf;
+void
+memRingEndRead(MemRing *ring, size_t len)
+{
+    size_t tail = ring->tail;
+    MEM_ASSERT(len <= ringDistance(ring, tail, atomicLoad(&ring->head)));
+    atomicStore(&ring->tail, ringAdvance(ring, tail, len));
+}
 
-        uint8_t grow_f = info->grow_f;
-        if (!grow_f) grow_f = 2;
+//=== Snapshots ===//
 
-        size_t next_cap = curr_cap;
-        if (!next_cap) next_cap = target_cap;
+// NOTE (Matteo): Snapshot layout: header, field table, arena memory (aligned to 16 bytes)
+typedef struct MemSnapshotHeader
+{
+    uint32_t magic;
+    uint32_t ptr_size;
+    size_t base, len, count;
+} MemSnapshotHeader;
 
-        while (next_cap < target_cap)
-        {
-            next_cap *= grow_f;
-        }
+enum
+{
+    SNAPSHOT_MAGIC = 0x4D454D53,
+    SNAPSHOT_ALIGN = 16,
+    SNAPSHOT_MAX_ALIGN = MEM_MIN_PAGE_SIZE,
+};
 
-        target_cap = next_cap;
-    }
+static inline size_t
+snapshotDataOffset(size_t count)
+{
+    return alignForward(sizeof(MemSnapshotHeader) + count * sizeof(size_t), SNAPSHOT_ALIGN);
+}
 
-    MEM_ASSERT(target_cap > curr_cap || info->strict_cap);
+MemBlock
+memSnapshotWrite(MemArena *mem, size_t const *fields, size_t count, MemArena *dst)
+{
+    MEM_ASSERT(mem && dst && mem != dst);
+    MEM_ASSERT(fields || !count);
 
-    MemBlock old_block = {.ptr = info->curr_buf, .len = curr_cap * info->item_size};
-    size_t new_size = target_cap * info->item_size;
+    size_t data_offset = snapshotDataOffset(count);
+    MemBlock block = memAllocUninit(dst, data_offset + mem->len, SNAPSHOT_ALIGN);
+    if (!block.ptr) return block;
+
+    MemSnapshotHeader *header = (MemSnapshotHeader *)block.ptr;
+    *header = (MemSnapshotHeader){
+        .magic = SNAPSHOT_MAGIC,
+        .ptr_size = sizeof(void *),
+        .base = (size_t)mem->ptr,
+        .len = mem->len,
+        .count = count,
+    };
 
-    if (memResize(mem, &old_block, new_size))
+    if (count) MEM_COPY(header + 1, fields, count * sizeof(*fields));
+    if (mem->len) MEM_COPY(block.ptr + data_offset, mem->ptr, mem->len);
+
+    for (size_t i = 0; i < count; ++i)
     {
-        *info->curr_cap_ptr = target_cap;
-        return old_block.ptr;
+        MEM_ASSERT(mem->len >= sizeof(size_t) && fields[i] <= mem->len - sizeof(size_t));
+        MEM_ASSERT((fields[i] & (sizeof(size_t) - 1)) == 0);
+
+        size_t value = *(size_t *)(mem->ptr + fields[i]);
+        MEM_ASSERT(!value || (value >= header->base && value <= header->base + mem->len));
+        (void)value;
     }
 
-    MemBlock new_block = memAlloc(mem, new_size, info->item_align);
-    if (new_block.ptr)
+    return block;
+}
+
+bool
+memSnapshotLoad(MemArena *mem, MemBlock snapshot)
+{
+    MEM_ASSERT(mem && !mem->len);
+    MEM_ASSERT(((size_t)snapshot.ptr & (SNAPSHOT_ALIGN - 1)) == 0);
+
+    if (!snapshot.ptr || snapshot.len < sizeof(MemSnapshotHeader)) return false;
+
+    MemSnapshotHeader const *header = (MemSnapshotHeader const *)snapshot.ptr;
+    if (header->magic != SNAPSHOT_MAGIC || header->ptr_size != sizeof(void *)) return false;
+    if (header->count > (snapshot.len - sizeof(*header)) / sizeof(size_t)) return false;
+
+    size_t data_offset = snapshotDataOffset(header->count);
+    if (data_offset > snapshot.len || header->len > snapshot.len - data_offset) return false;
+
+    // NOTE (Matteo): The delta must preserve the alignment of the original allocations
+    size_t delta = (size_t)mem->ptr - header->base;
+    if (delta & (SNAPSHOT_MAX_ALIGN - 1)) return false;
+
+    // NOTE (Matteo): The field table is validated upfront, so that a corrupted snapshot cannot
+    // cause writes out of the arena
+    size_t const *fields = (size_t const *)(header + 1);
+    size_t max_field = header->len < sizeof(size_t) ? 0 : header->len - sizeof(size_t);
+    bool invalid = (header->count && header->len < sizeof(size_t));
+    for (size_t i = 0; i < header->count; ++i)
     {
-        // NOTE (Matteo): Copy and free old data
-        MEM_COPY(new_block.ptr, old_block.ptr, old_block.len);
-        memFree(mem, &old_block);
+        invalid |= (fields[i] > max_field) | ((fields[i] & (sizeof(size_t) - 1)) != 0);
+    }
+    if (invalid) return false;
 
-        *info->curr_cap_ptr = target_cap;
-        return new_block.ptr;
+    MemBlock block = memAllocUninit(mem, header->len, 1);
+    if (header->len && !block.ptr) return false;
+    MEM_ASSERT(!header->len || block.ptr == mem->ptr);
+
+    if (header->len) MEM_COPY(mem->ptr, snapshot.ptr + data_offset, header->len);
+
+    // NOTE (Matteo): The fix up loop is branch free (NULL pointers are masked out of the delta) so
+    // that its cost is dominated by the memory accesses
+    for (size_t i = 0; i < header->count; ++i)
+    {
+        size_t *field = (size_t *)(mem->ptr + fields[i]);
+        size_t value = *field;
+        *field = value + (delta & (0 - (size_t)(value != 0)));
     }
 
-    return NULL;
+    return true;
 }
 
 #endif // MEM_IMPLEMENTATION
@@ -590,6 +4875,5 @@ memReallocBufEx(MemArena *mem, MemBufInfo const *info)
 // TODO (Matteo):
 // * Naming review
 // * More usage code, especially for dynamic buffers
-// * Fork/join allocators
 
 //==================================================================================================
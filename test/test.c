@@ -1,5 +1,18 @@
+// NOTE (Matteo): Required on POSIX for the virtual memory extensions used by the implementation
+#define _DEFAULT_SOURCE
+
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+
+#if !defined(__STDC_NO_THREADS__)
+#include <threads.h>
+#endif
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #define MEM_ASSERT assert
 #define MEM_IMPLEMENTATION
@@ -33,6 +46,124 @@ bufFree(Buf *buf)
     return false;
 }
 
+void
+tlsfTest(void)
+{
+    MemTlsf tlsf;
+    bool result = memTlsfInit(&tlsf, &(MemArenaInfo){
+                                         .available_size = MEM_GB(1),
+                                         .decommit_threshold = MEM_KB(64),
+                                     });
+    MEM_ASSERT(result);
+
+    enum
+    {
+        SLOTS = 512
+    };
+
+    uint8_t *ptrs[SLOTS] = {0};
+    size_t sizes[SLOTS] = {0};
+    uint32_t seed = 12345;
+
+    for (size_t iter = 0; iter < 20000; ++iter)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        size_t index = (seed >> 8) % SLOTS;
+
+        if (ptrs[index])
+        {
+            // NOTE (Matteo): Check content before releasing or resizing
+            for (size_t i = 0; i < sizes[index]; ++i) MEM_ASSERT(ptrs[index][i] == (uint8_t)index);
+
+            if (seed & 1)
+            {
+                memTlsfFree(&tlsf, ptrs[index]);
+                ptrs[index] = NULL;
+                continue;
+            }
+
+            size_t size = 1 + (seed >> 12) % (seed & 2 ? MEM_KB(200) : 256);
+            ptrs[index] = memTlsfRealloc(&tlsf, ptrs[index], size);
+            MEM_ASSERT(ptrs[index] && ((uintptr_t)ptrs[index] & 15) == 0);
+            if (size > sizes[index])
+            {
+                MEM_SET(ptrs[index] + sizes[index], (int)index, size - sizes[index]);
+            }
+            sizes[index] = size;
+        }
+        else
+        {
+            size_t size = 1 + (seed >> 12) % (seed & 2 ? MEM_KB(200) : 256);
+            ptrs[index] = memTlsfAlloc(&tlsf, size);
+            MEM_ASSERT(ptrs[index] && ((uintptr_t)ptrs[index] & 15) == 0);
+            MEM_SET(ptrs[index], (int)index, size);
+            sizes[index] = size;
+        }
+    }
+
+    for (size_t index = 0; index < SLOTS; ++index) memTlsfFree(&tlsf, ptrs[index]);
+
+    // NOTE (Matteo): Once everything is free, the region shrinks back to the sentinel
+    MEM_ASSERT(tlsf.region.len == 16 && tlsf.fl_bitmap == 0);
+
+    memTlsfRelease(&tlsf);
+}
+
+void
+registryVisitor(MemArenaReport const *report, void *context)
+{
+    // NOTE (Matteo): Keep the most recently registered arena
+    MemArenaReport *first = context;
+    if (!first->arena) *first = *report;
+}
+
+#if !defined(__STDC_NO_THREADS__)
+
+enum
+{
+    CONCURRENT_THREADS = 8,
+    CONCURRENT_ALLOCS = 2000,
+};
+
+int
+concurrentProc(void *arg)
+{
+    MemArena *mem = arg;
+
+    for (size_t i = 0; i < CONCURRENT_ALLOCS; ++i)
+    {
+        uint32_t *item = memAllocStruct(mem, uint32_t);
+        if (!item || *item) return 1;
+        *item = (uint32_t)thrd_current();
+    }
+
+    return 0;
+}
+
+enum
+{
+    RING_BYTES = 1 << 20,
+};
+
+int
+ringProducer(void *arg)
+{
+    MemRing *ring = arg;
+
+    for (size_t written = 0; written < RING_BYTES;)
+    {
+        MemBlock block = memRingBeginWrite(ring);
+        size_t len = block.len < RING_BYTES - written ? block.len : RING_BYTES - written;
+        for (size_t i = 0; i < len; ++i) block.ptr[i] = (uint8_t)(written + i);
+        memRingEndWrite(ring, len);
+        written += len;
+    }
+
+    return 0;
+}
+
+#endif
+
 int
 main(void)
 {
@@ -49,6 +180,893 @@ main(void)
     MEM_ASSERT(result);
     MEM_ASSERT(!block.ptr);
 
+    // NOTE (Matteo): Decommitted pages must be zeroed when committed again
+    block = memAlloc(mem, MEM_KB(256), 8);
+    MEM_ASSERT(block.ptr);
+    MEM_SET(block.ptr, 0xFF, block.len);
+    result = memFree(mem, &block);
+    MEM_ASSERT(result);
+    block = memAlloc(mem, MEM_KB(256), 8);
+    MEM_ASSERT(block.ptr && block.ptr[block.len - 1] == 0);
+    result = memFree(mem, &block);
+    MEM_ASSERT(result);
+
+    // NOTE (Matteo): Commit granularity and decommit hysteresis
+    {
+        MemArena *chunked = memReserve(&(MemArenaInfo){
+            .available_size = MEM_MB(16),
+            .commit_size = MEM_KB(64),
+            .decommit_threshold = MEM_KB(128),
+        });
+
+        block = memAlloc(chunked, 1, 1);
+        MEM_ASSERT(block.ptr && chunked->commit == MEM_KB(64));
+        block.ptr[0] = 1;
+        result = memFree(chunked, &block);
+        MEM_ASSERT(result && chunked->commit == MEM_KB(64));
+
+        block = memAlloc(chunked, MEM_KB(200), 1);
+        MEM_ASSERT(block.ptr && block.ptr[0] == 0 && chunked->commit == MEM_KB(256));
+        memClear(chunked);
+        MEM_ASSERT(chunked->commit == 0);
+
+        block = memAlloc(chunked, MEM_KB(100), 1);
+        memTrim(chunked, 0);
+        MEM_ASSERT(chunked->commit == alignForward(MEM_KB(100), chunked->page_size));
+
+        memRelease(chunked);
+    }
+
+    // NOTE (Matteo): Deferred zeroing
+    {
+        MemArena *no_zero = memReserve(&(MemArenaInfo){
+            .available_size = MEM_MB(16),
+            .unsafe = true,
+            .no_zero = true,
+        });
+
+        block = memAllocUninit(no_zero, 64, 1);
+        MEM_SET(block.ptr, 0xFF, block.len);
+        memClear(no_zero);
+
+        block = memAllocUninit(no_zero, 32, 1);
+        MEM_ASSERT(block.ptr && block.ptr[0] == 0xFF);
+        result = memResize(no_zero, &block, 64);
+        MEM_ASSERT(result && block.ptr[31] == 0xFF && block.ptr[32] == 0 && block.ptr[63] == 0);
+        memClear(no_zero);
+
+        block = memAlloc(no_zero, 64, 1);
+        MEM_ASSERT(block.ptr && block.ptr[0] == 0 && block.ptr[63] == 0);
+
+        memRelease(no_zero);
+    }
+
+    // NOTE (Matteo): Inline fast path (disabled when collecting statistics, counters or probes)
+    {
+        block = memAlloc(mem, 1, 1);
+        MEM_ASSERT(block.ptr);
+#if !defined(MEM_ENABLE_STATS) && !defined(MEM_ENABLE_PERF) && !defined(MEM_ENABLE_USDT)
+        MEM_ASSERT(mem->fast_cap == mem->commit);
+#else
+        MEM_ASSERT(mem->fast_cap == 0);
+#endif
+
+        MemBlock fast = memAllocFast(mem, 16, 16);
+        MEM_ASSERT(fast.ptr && ((uintptr_t)fast.ptr & 15) == 0 && fast.ptr[0] == 0);
+        MEM_ASSERT(mem->len == (size_t)(fast.ptr + fast.len - mem->ptr));
+
+        // NOTE (Matteo): Falls back to the slow path when exceeding the committed memory
+        fast = memAllocFast(mem, mem->commit, 8);
+        MEM_ASSERT(fast.ptr);
+#if !defined(MEM_ENABLE_STATS) && !defined(MEM_ENABLE_PERF) && !defined(MEM_ENABLE_USDT)
+        MEM_ASSERT(mem->fast_cap == mem->commit);
+#else
+        MEM_ASSERT(mem->fast_cap == 0);
+#endif
+
+        uint64_t *item = memAllocStruct(mem, uint64_t);
+        MEM_ASSERT(item && *item == 0);
+
+        memClear(mem);
+    }
+
+    // NOTE (Matteo): Savepoints
+    {
+        MemBlock first = memAlloc(mem, 32, 8);
+        MemArenaMark mark = memSave(mem);
+
+        for (size_t i = 0; i < 100; ++i)
+        {
+            block = memAlloc(mem, MEM_KB(1), 16);
+            MEM_SET(block.ptr, 0xFF, block.len);
+        }
+
+        memRestore(mem, mark);
+        MEM_ASSERT(mem->len == (size_t)(first.ptr + first.len - mem->ptr));
+
+        block = memAlloc(mem, MEM_KB(1), 16);
+        MEM_ASSERT(block.ptr && block.ptr[0] == 0 && block.ptr[block.len - 1] == 0);
+
+        memClear(mem);
+    }
+
+    // NOTE (Matteo): Scratch arenas
+    {
+        MemScratch outer = memGetScratch(&mem, 1);
+        MEM_ASSERT(outer.mem && outer.mem != mem);
+        block = memAlloc(outer.mem, 64, 8);
+
+        MemScratch inner = memGetScratch(&outer.mem, 1);
+        MEM_ASSERT(inner.mem && inner.mem != outer.mem);
+        memAlloc(inner.mem, 64, 8);
+        memReleaseScratch(inner);
+        MEM_ASSERT(inner.mem->len == 0);
+
+        MemArena *conflicts[] = {outer.mem, inner.mem};
+        MEM_ASSERT(!memGetScratch(conflicts, 2).mem);
+
+        memReleaseScratch(outer);
+        MEM_ASSERT(outer.mem->len == 0);
+        memReleaseThreadScratch();
+    }
+
+#if !defined(__STDC_NO_THREADS__)
+    // NOTE (Matteo): Concurrent arena
+    {
+        MemArena *shared = memReserve(&(MemArenaInfo){
+            .available_size = MEM_MB(64),
+            .concurrent = true,
+        });
+
+        thrd_t threads[CONCURRENT_THREADS];
+        for (size_t i = 0; i < CONCURRENT_THREADS; ++i)
+        {
+            thrd_create(&threads[i], concurrentProc, shared);
+        }
+
+        for (size_t i = 0; i < CONCURRENT_THREADS; ++i)
+        {
+            int thread_result = 1;
+            thrd_join(threads[i], &thread_result);
+            MEM_ASSERT(thread_result == 0);
+        }
+
+        MEM_ASSERT(shared->len == CONCURRENT_THREADS * CONCURRENT_ALLOCS * sizeof(uint32_t));
+        MEM_ASSERT(shared->commit >= shared->len);
+
+        // NOTE (Matteo): Released memory is cleared when allocated again
+        block = memAlloc(shared, 64, 8);
+        MEM_SET(block.ptr, 0xFF, block.len);
+        result = memResize(shared, &block, 32);
+        MEM_ASSERT(result);
+        MemBlock tail = memAllocUninit(shared, 32, 1);
+        MEM_ASSERT(tail.ptr == block.ptr + 32 && tail.ptr[0] == 0 && tail.ptr[31] == 0);
+        result = memResize(shared, &tail, 64);
+        MEM_ASSERT(result && tail.ptr[32] == 0);
+
+        // NOTE (Matteo): Blocks that are not the last one cannot be freed, and are left intact
+        MEM_SET(block.ptr, 0xAB, block.len);
+        result = memFree(shared, &block);
+        MEM_ASSERT(!result && block.ptr[0] == 0xAB && block.ptr[block.len - 1] == 0xAB);
+        result = memFree(shared, &tail);
+        MEM_ASSERT(result);
+        result = memFree(shared, &block);
+        MEM_ASSERT(result);
+
+        memRelease(shared);
+    }
+#endif
+
+    // NOTE (Matteo): Fork/join
+    {
+        memAlloc(mem, 100, 8);
+
+        MemArena *child_a = memFork(mem, MEM_MB(1));
+        MemArena *child_b = memFork(mem, MEM_MB(1));
+        MEM_ASSERT(child_a && child_b);
+        MEM_ASSERT(!memFork(mem, memAvailable(mem)));
+
+        MemBlock block_a = memAlloc(child_a, MEM_KB(100), 8);
+        MemBlock block_b = memAlloc(child_b, MEM_KB(100), 8);
+        MEM_ASSERT(block_a.ptr && block_b.ptr);
+        MEM_SET(block_a.ptr, 0xAA, block_a.len);
+        MEM_SET(block_b.ptr, 0xBB, block_b.len);
+
+        // NOTE (Matteo): Joining out of order leaks the child range, but keeps its data
+        memJoin(child_a, false);
+        MEM_ASSERT(block_a.ptr[block_a.len - 1] == 0xAA);
+
+        // NOTE (Matteo): Discarding the last child gives its range back
+        size_t len_before_b = (size_t)((uint8_t *)child_b - mem->ptr);
+        memJoin(child_b, true);
+        MEM_ASSERT(mem->len <= len_before_b);
+
+        block = memAlloc(mem, MEM_KB(200), 8);
+        MEM_ASSERT(block.ptr && block.ptr[0] == 0 && block.ptr[block.len - 1] == 0);
+
+        // NOTE (Matteo): Folding the last child keeps its data as part of the parent
+        MemArena *child_c = memFork(mem, MEM_MB(1));
+        MemBlock block_c = memAlloc(child_c, 64, 8);
+        MEM_SET(block_c.ptr, 0xCC, block_c.len);
+        memJoin(child_c, false);
+        MEM_ASSERT(mem->len == (size_t)(block_c.ptr + block_c.len - mem->ptr));
+        MEM_ASSERT(block_c.ptr[63] == 0xCC);
+
+        block = memAlloc(mem, MEM_MB(2), 8);
+        MEM_ASSERT(block.ptr && block.ptr[0] == 0 && block.ptr[block.len - 1] == 0);
+
+        memClear(mem);
+    }
+
+    // NOTE (Matteo): Chained arenas
+    for (int retain = 0; retain < 2; ++retain)
+    {
+        MemArena *chain = memReserve(&(MemArenaInfo){
+            .available_size = MEM_KB(64),
+            .chained = true,
+            .chain_retain = retain,
+        });
+
+        block = memAlloc(chain, MEM_KB(60), 8);
+        MemArenaMark mark = memSave(chain);
+
+        MemBlock big = memAlloc(chain, MEM_KB(100), 8);
+        MEM_ASSERT(big.ptr && chain->prev && chain->base_pos == MEM_KB(60));
+        MEM_SET(big.ptr, 0xFF, big.len);
+
+        MemBlock huge = memAlloc(chain, MEM_MB(1), 4096);
+        MEM_ASSERT(huge.ptr && ((uintptr_t)huge.ptr & 4095) == 0);
+        MEM_ASSERT(memSave(chain).pos == MEM_KB(160) + MEM_MB(1));
+
+#if defined(MEM_ENABLE_STATS)
+        MemArenaStats stats;
+        memGetStats(chain, &stats);
+        size_t decommit_bytes = stats.decommit_bytes;
+#endif
+
+        memRestore(chain, mark);
+        MEM_ASSERT(!chain->prev && chain->len == MEM_KB(60));
+        MEM_ASSERT(retain ? chain->spare != NULL : chain->spare == NULL);
+
+#if defined(MEM_ENABLE_STATS)
+        // NOTE (Matteo): Retained blocks are decommitted
+        memGetStats(chain, &stats);
+        MEM_ASSERT(!retain || stats.decommit_bytes >= decommit_bytes + MEM_KB(100) + MEM_MB(1));
+#endif
+
+        big = memAlloc(chain, MEM_KB(100), 8);
+        MEM_ASSERT(big.ptr && big.ptr[0] == 0 && big.ptr[big.len - 1] == 0);
+
+        memClear(chain);
+        MEM_ASSERT(!chain->prev && chain->len == 0);
+
+        memRelease(chain);
+    }
+
+    // NOTE (Matteo): Pool allocator
+    {
+        typedef struct Session
+        {
+            uint64_t id;
+            char name[20];
+        } Session;
+
+        MemPool pool = {0};
+        memPoolInit(&pool, mem, sizeof(Session), MEM_ALIGNOF(Session));
+
+        Session *sessions[1000];
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            sessions[i] = memPoolAllocStruct(&pool, Session);
+            MEM_ASSERT(sessions[i] && sessions[i]->id == 0);
+            sessions[i]->id = i + 1;
+        }
+
+        // NOTE (Matteo): Slots are recycled in any order
+        memPoolFree(&pool, sessions[500]);
+        memPoolFree(&pool, sessions[10]);
+        size_t len = mem->len;
+
+        Session *recycled = memPoolAllocStruct(&pool, Session);
+        MEM_ASSERT(recycled == sessions[10] && recycled->id == 0);
+        recycled = memPoolAllocStruct(&pool, Session);
+        MEM_ASSERT(recycled == sessions[500] && recycled->id == 0);
+        MEM_ASSERT(mem->len == len);
+
+        memClear(mem);
+        memPoolReset(&pool);
+        MEM_ASSERT(memPoolAlloc(&pool));
+
+        memClear(mem);
+    }
+
+    // NOTE (Matteo): Slab allocator
+    {
+        MemSlab slab;
+        result = memSlabInit(&slab, mem, MEM_MB(1));
+        MEM_ASSERT(result);
+
+        for (size_t size = 1; size <= MEM_SLAB_MAX_SIZE; ++size)
+        {
+            size_t index = slabClassIndex(size);
+            MEM_ASSERT(index < MEM_SLAB_CLASSES && slabClassSize(index) >= size);
+            MEM_ASSERT(!index || slabClassSize(index - 1) < size);
+        }
+
+        uint8_t *small = memSlabAlloc(&slab, 20);
+        uint8_t *large = memSlabAlloc(&slab, 1000);
+        MEM_ASSERT(small && large && ((uintptr_t)small & 7) == 0);
+        MEM_SET(small, 0xFF, 20);
+
+        memSlabFree(&slab, small);
+        memSlabFree(&slab, large);
+        MEM_ASSERT(memSlabAlloc(&slab, 24) == small && small[0] == 0);
+        MEM_ASSERT(memSlabAlloc(&slab, 1024) == large);
+        MEM_ASSERT(!memSlabAlloc(&slab, MEM_SLAB_MAX_SIZE + 1));
+
+        memSlabReset(&slab);
+        MEM_ASSERT(memSlabAlloc(&slab, 24) == small);
+
+        memSlabRelease(&slab);
+        MEM_ASSERT(mem->len == 0);
+    }
+
+    tlsfTest();
+
+    // NOTE (Matteo): Double-ended arena
+    {
+        MemArena *both = memReserve(&(MemArenaInfo){.available_size = MEM_MB(1)});
+
+        MemBlock front = memAlloc(both, MEM_KB(100), 8);
+        MemBlock back = memAllocBack(both, MEM_KB(100), 64);
+        MEM_ASSERT(front.ptr && back.ptr && ((uintptr_t)back.ptr & 63) == 0);
+        MEM_ASSERT(back.ptr + back.len <= both->ptr + both->cap);
+        MEM_ASSERT(memAvailable(both) <= MEM_MB(1) - MEM_KB(200));
+        MEM_SET(front.ptr, 0xAA, front.len);
+        MEM_SET(back.ptr, 0xBB, back.len);
+
+        // NOTE (Matteo): The two ends cannot overlap
+        MEM_ASSERT(!memAllocBack(both, memAvailable(both) + 1, 1).ptr);
+        MEM_ASSERT(!memAlloc(both, memAvailable(both) + 1, 1).ptr);
+        block = memAllocBack(both, memAvailable(both), 1);
+        MEM_ASSERT(block.ptr && memAvailable(both) == 0);
+        MEM_ASSERT(!memAllocFast(both, 1, 1).ptr);
+
+        memClearBack(both);
+        MEM_ASSERT(front.ptr[front.len - 1] == 0xAA);
+
+        MemArenaMark mark = memSaveBack(both);
+        back = memAllocBack(both, MEM_KB(300), 8);
+        MEM_ASSERT(back.ptr && back.ptr[0] == 0 && back.ptr[back.len - 1] == 0);
+        memRestoreBack(both, mark);
+
+        block = memAlloc(both, MEM_KB(800), 8);
+        MEM_ASSERT(block.ptr && block.ptr[0] == 0 && block.ptr[block.len - 1] == 0);
+
+        memClear(both);
+        memRelease(both);
+    }
+
+    // NOTE (Matteo): Double-ended arena, with memory left dirty by the front end
+    {
+        MemArena *both = memReserve(&(MemArenaInfo){
+            .available_size = MEM_KB(64),
+            .no_zero = true,
+            .unsafe = true,
+        });
+
+        MemBlock front = memAlloc(both, MEM_KB(60), 1);
+        MEM_ASSERT(front.ptr);
+        MEM_SET(front.ptr, 0xFF, front.len);
+        memRestore(both, (MemArenaMark){0});
+
+        MemBlock back = memAllocBack(both, MEM_KB(60), 1);
+        MEM_ASSERT(back.ptr && back.ptr < front.ptr + front.len);
+        for (size_t i = 0; i < back.len; ++i) MEM_ASSERT(back.ptr[i] == 0);
+
+        // NOTE (Matteo): The front end can reuse the memory after the back end is cleared
+        memClearBack(both);
+        front = memAlloc(both, MEM_KB(60), 1);
+        MEM_ASSERT(front.ptr && front.ptr[front.len - 1] == 0);
+
+        memRelease(both);
+    }
+
+    // NOTE (Matteo): Ring buffer
+    {
+        MemRing ring = {0};
+        result = memRingInit(&ring, 1000);
+        MEM_ASSERT(result);
+        MEM_ASSERT(ring.cap >= 1000);
+
+        block = memRingBeginWrite(&ring);
+        MEM_ASSERT(block.ptr == ring.ptr && block.len == ring.cap);
+        memRingEndWrite(&ring, ring.cap - 10);
+        block = memRingBeginRead(&ring);
+        MEM_ASSERT(block.len == ring.cap - 10);
+        memRingEndRead(&ring, block.len);
+
+        // NOTE (Matteo): Spans crossing the end of the buffer are contiguous
+        block = memRingBeginWrite(&ring);
+        MEM_ASSERT(block.ptr == ring.ptr + ring.cap - 10 && block.len == ring.cap);
+        for (size_t i = 0; i < 100; ++i) block.ptr[i] = (uint8_t)i;
+        memRingEndWrite(&ring, 100);
+        MEM_ASSERT(ring.ptr[0] == 10 && ring.ptr[89] == 99);
+        block = memRingBeginRead(&ring);
+        MEM_ASSERT(block.len == 100 && block.ptr[0] == 0 && block.ptr[99] == 99);
+        memRingEndRead(&ring, 100);
+
+#if !defined(__STDC_NO_THREADS__)
+        thrd_t producer;
+        thrd_create(&producer, ringProducer, &ring);
+
+        for (size_t read = 0; read < RING_BYTES;)
+        {
+            block = memRingBeginRead(&ring);
+            for (size_t i = 0; i < block.len; ++i) MEM_ASSERT(block.ptr[i] == (uint8_t)(read + i));
+            memRingEndRead(&ring, block.len);
+            read += block.len;
+        }
+
+        int thread_result;
+        thrd_join(producer, &thread_result);
+        MEM_ASSERT(thread_result == 0);
+#endif
+
+        memRingRelease(&ring);
+        MEM_ASSERT(!ring.ptr);
+    }
+
+    // NOTE (Matteo): Statistics
+    {
+        MemArena *counted = memReserve(&(MemArenaInfo){.available_size = MEM_MB(16)});
+        MemArenaStats stats;
+
+        MemBlock first = memAlloc(counted, 10, 1);
+        MemBlock second = memAlloc(counted, MEM_MB(1), 16);
+        MEM_ASSERT(first.ptr && second.ptr);
+        result = memFree(counted, &first);
+        MEM_ASSERT(!result);
+
+        uint32_t *items = NULL;
+        size_t cap = 0;
+        items = memReallocBuf(counted, uint32_t, items, 4, &cap);
+        MEM_ASSERT(items);
+        second = memAlloc(counted, 1, 1);
+        MEM_ASSERT(second.ptr);
+        items = memReallocBuf(counted, uint32_t, items, 8, &cap);
+        MEM_ASSERT(items);
+
+#if defined(MEM_ENABLE_STATS)
+        result = memGetStats(counted, &stats);
+        MEM_ASSERT(result);
+        MEM_ASSERT(stats.allocs == 5 && stats.failed_frees == 2 && stats.frees == 2);
+        MEM_ASSERT(stats.align_padding == 6 + 3);
+        MEM_ASSERT(stats.realloc_leaked == 4 * sizeof(uint32_t));
+        MEM_ASSERT(stats.len == counted->len && stats.peak_len == stats.len);
+        MEM_ASSERT(stats.commits > 0 && stats.commit_bytes == stats.commit);
+
+        memClear(counted);
+        result = memGetStats(counted, &stats);
+        MEM_ASSERT(stats.len == 0 && stats.peak_len > 0 && stats.decommits > 0);
+        memResetPeak(counted);
+        result = memGetStats(counted, &stats);
+        MEM_ASSERT(stats.peak_len == 0 && stats.peak_commit == stats.commit);
+#else
+        result = memGetStats(counted, &stats);
+        MEM_ASSERT(!result && stats.allocs == 0);
+#endif
+
+        memRelease(counted);
+
+#if defined(MEM_ENABLE_STATS)
+        // NOTE (Matteo): Pages committed by both ends are counted once
+        size_t page_size = pageSize();
+        counted = memReserve(&(MemArenaInfo){.available_size = 4 * page_size});
+        block = memAlloc(counted, page_size + page_size / 2, 1);
+        MemBlock back = memAllocBack(counted, 2 * page_size + page_size / 4, 1);
+        MEM_ASSERT(block.ptr && back.ptr);
+        MEM_ASSERT(counted->commit + counted->back_commit > 4 * page_size);
+
+        result = memGetStats(counted, &stats);
+        MEM_ASSERT(result && stats.commit == 4 * page_size && stats.peak_commit == stats.commit);
+
+        memRelease(counted);
+#endif
+    }
+
+    // NOTE (Matteo): Performance counters
+    {
+        MemArena *measured = memReserve(&(MemArenaInfo){.available_size = MEM_MB(16)});
+        MemPerfStats perf;
+
+#if defined(MEM_ENABLE_PERF)
+        block = memAlloc(measured, MEM_MB(1), 8);
+        MEM_ASSERT(block.ptr);
+        memClear(measured);
+        // NOTE (Matteo): Released memory is cleared, unless the page is decommitted
+        block = memAlloc(measured, 100, 8);
+        MEM_ASSERT(block.ptr);
+        block = memAlloc(measured, 100, 8);
+        result = memFree(measured, &block);
+        MEM_ASSERT(result);
+
+        result = memGetPerf(measured, &perf);
+        MEM_ASSERT(result);
+        MEM_ASSERT(perf.ops[MEM_PERF_COMMIT].count == 2 && perf.ops[MEM_PERF_DECOMMIT].count == 1);
+        MEM_ASSERT(perf.ops[MEM_PERF_FIRST_TOUCH].count == 2 && perf.ops[MEM_PERF_ZERO].count == 1);
+        // NOTE (Matteo): Committed pages are populated on the first write
+        MEM_ASSERT(!(perf.available & MEM_PERF_PAGE_FAULTS) ||
+                   perf.ops[MEM_PERF_FIRST_TOUCH].page_faults > 0);
+
+        memResetPerf(measured);
+        result = memGetPerf(measured, &perf);
+        MEM_ASSERT(result && perf.ops[MEM_PERF_FIRST_TOUCH].count == 0);
+        memReleaseThreadPerf();
+#else
+        result = memGetPerf(measured, &perf);
+        MEM_ASSERT(!result && perf.ops[MEM_PERF_COMMIT].count == 0);
+#endif
+
+        memRelease(measured);
+    }
+
+    // NOTE (Matteo): Tracing
+    {
+        MemArena *traced = memReserve(&(MemArenaInfo){.available_size = MEM_MB(16)});
+        MemTrace trace;
+        result = memTraceInit(&trace, mem, 6);
+        MEM_ASSERT(result && trace.cap == 8);
+
+        memSetTrace(traced, &trace);
+        MEM_ASSERT(traced->fast_cap == 0);
+
+        block = memAlloc(traced, 100, 16);
+        MEM_ASSERT(block.ptr);
+        result = memFree(traced, &block);
+        MEM_ASSERT(result);
+        memClear(traced);
+
+        // NOTE (Matteo): Resize events are recorded after the commit operations they trigger
+        MEM_ASSERT(trace.next == 5);
+        MEM_ASSERT(trace.events[0].kind == MEM_TRACE_ALLOC && trace.events[0].alignment == 16);
+        MEM_ASSERT(trace.events[1].kind == MEM_TRACE_COMMIT && trace.events[1].time > 0);
+        MEM_ASSERT(trace.events[2].kind == MEM_TRACE_DECOMMIT);
+        MEM_ASSERT(trace.events[3].kind == MEM_TRACE_RESIZE && trace.events[3].size == 0);
+        MEM_ASSERT(trace.events[4].kind == MEM_TRACE_CLEAR);
+
+        // NOTE (Matteo): Older events are overwritten
+        for (size_t i = 0; i < 4; ++i) memAlloc(traced, 8, 8);
+        MEM_ASSERT(trace.next == 10 && trace.events[0].seq == 9);
+
+        MemBlock json = memTraceExport(&trace, mem);
+        MEM_ASSERT(json.ptr && json.ptr[json.len] == 0);
+        char const prefix[] = "{\"traceEvents\":[{\"name\":";
+        MEM_ASSERT(!strncmp((char *)json.ptr, prefix, sizeof(prefix) - 1));
+        MEM_ASSERT(strstr((char *)json.ptr, "\"ph\":\"X\"") && json.ptr[json.len - 1] == '}');
+
+        memSetTrace(traced, NULL);
+        memRelease(traced);
+    }
+
+    // NOTE (Matteo): Heap profiling
+    {
+        MemArena *profiled = memReserve(&(MemArenaInfo){.available_size = MEM_MB(16)});
+        MemProfile profile;
+        result = memProfileInit(&profile, mem, 1000, 128);
+        MEM_ASSERT(result && profile.period == 1024 && profile.site_cap == 256);
+
+        memSetProfile(profiled, &profile);
+        MEM_ASSERT(profiled->fast_cap == 0);
+
+        // NOTE (Matteo): Allocations larger than the period are always sampled
+        block = memAlloc(profiled, 4096, 16);
+        MEM_ASSERT(block.ptr && profile.site_len == 1 && profile.live_len == 1);
+        size_t live_bytes = 0;
+        for (size_t i = 0; i < profile.site_cap; ++i) live_bytes += profile.sites[i].live_bytes;
+        MEM_ASSERT(live_bytes == 4096);
+
+        // NOTE (Matteo): Samples are released when the arena shrinks past them
+        result = memFree(profiled, &block);
+        MEM_ASSERT(result && profile.live_len == 0);
+
+        // NOTE (Matteo): The estimate of small allocations is unbiased
+        for (size_t i = 0; i < 1000; ++i) memAlloc(profiled, 64, 8);
+        size_t total_bytes = 0;
+        live_bytes = 0;
+        for (size_t i = 0; i < profile.site_cap; ++i)
+        {
+            live_bytes += profile.sites[i].live_bytes;
+            total_bytes += profile.sites[i].total_bytes;
+        }
+        MEM_ASSERT(live_bytes > 32000 && live_bytes < 128000);
+        MEM_ASSERT(total_bytes == live_bytes + 4096);
+
+        memClear(profiled);
+        MEM_ASSERT(profile.live_len == 0 && profiled->profile_top == 0);
+
+        MemBlock folded = memProfileExport(&profile, mem, MEM_PROFILE_FOLDED_TOTAL);
+        MEM_ASSERT(folded.ptr && folded.ptr[folded.len] == 0 && folded.ptr[folded.len - 1] == '\n');
+        folded = memProfileExport(&profile, mem, MEM_PROFILE_FOLDED_LIVE);
+        MEM_ASSERT(folded.ptr && folded.len == 0);
+
+        MemBlock pprof = memProfileExport(&profile, mem, MEM_PROFILE_PPROF);
+        char const prefix[] = "heap profile: 0: 0 [";
+        MEM_ASSERT(pprof.ptr && !strncmp((char *)pprof.ptr, prefix, sizeof(prefix) - 1));
+
+        // NOTE (Matteo): The profiled arena can store the export as well
+        pprof = memProfileExport(&profile, profiled, MEM_PROFILE_PPROF);
+        MEM_ASSERT(pprof.ptr && profile.live_len >= 1);
+        memClear(profiled);
+        MEM_ASSERT(profile.live_len == 0);
+
+        memSetProfile(profiled, NULL);
+        memRelease(profiled);
+    }
+
+    // NOTE (Matteo): Arena registry
+    {
+        MemArena *named = memReserve(&(MemArenaInfo){
+            .available_size = MEM_MB(1),
+            .name = "registry test arena with a name longer than the limit",
+            .tag = 42,
+        });
+        MEM_ASSERT(named && strlen(named->name) == MEM_ARENA_NAME_LEN - 1);
+
+        block = memAlloc(named, 5000, 8);
+        MEM_ASSERT(block.ptr);
+
+        MemArenaReport report = {0};
+        size_t count = memForEachArena(registryVisitor, &report);
+        MEM_ASSERT(count >= 1 && report.arena == named && report.tag == 42);
+        MEM_ASSERT(report.used == 5000 && report.committed >= 5000);
+
+        FILE *stream = tmpfile();
+        MEM_ASSERT(stream);
+        memDumpArenas(stream);
+        char line[256];
+        rewind(stream);
+        MEM_ASSERT(fgets(line, sizeof(line), stream) && !strncmp(line, "name", 4));
+        MEM_ASSERT(fgets(line, sizeof(line), stream) && !strncmp(line, named->name, 31));
+        fclose(stream);
+
+        memRelease(named);
+        MEM_ASSERT(memForEachArena(registryVisitor, &report) == count - 1);
+    }
+
+    // NOTE (Matteo): Compressed references
+    {
+        typedef struct TreeNode
+        {
+            MemRef left, right;
+            uint64_t key;
+        } TreeNode;
+
+        _Static_assert(sizeof(TreeNode) == 16, "Unexpected node size");
+
+        MemArena *tree = memReserve(&(MemArenaInfo){.available_size = MEM_MB(1)});
+
+        TreeNode *root = memAllocStruct(tree, TreeNode);
+        TreeNode *left = memAllocStruct(tree, TreeNode);
+        root->key = 1;
+        left->key = 2;
+        root->left = memRefOf(tree, TreeNode, left);
+        MEM_ASSERT(memRefOf(tree, TreeNode, root).val == 1);
+        MEM_ASSERT(memRefGet(tree, TreeNode, root->left) == left);
+        MEM_ASSERT(memRefGet(tree, TreeNode, root->right) == NULL);
+        MEM_ASSERT(memRefGet(tree, TreeNode, memRefOf(tree, TreeNode, root)) == root);
+
+        MemRef ref = memRefEncode(tree, &left->key);
+        MEM_ASSERT(memRefDecode(tree, ref) == &left->key);
+        MEM_ASSERT(memRefEncode(tree, NULL).val == 0);
+
+        memRelease(tree);
+    }
+
+    // NOTE (Matteo): Snapshots
+    {
+        typedef struct Link
+        {
+            struct Link *next;
+            size_t value;
+        } Link;
+
+        MemArena *src = memReserve(&(MemArenaInfo){.available_size = MEM_MB(1)});
+        MemArena *dst = memReserve(&(MemArenaInfo){.available_size = MEM_MB(1)});
+
+        size_t fields[8];
+        Link *list = NULL;
+        for (size_t i = 0; i < 8; ++i)
+        {
+            Link *link = memAllocStruct(src, Link);
+            link->next = list;
+            link->value = i;
+            list = link;
+            fields[i] = (size_t)((uint8_t *)&link->next - src->ptr);
+        }
+
+        block = memSnapshotWrite(src, fields, 8, mem);
+        MEM_ASSERT(block.ptr);
+
+        result = memSnapshotLoad(dst, block);
+        MEM_ASSERT(result && dst->len == src->len);
+
+        list = (Link *)(dst->ptr + ((uint8_t *)list - src->ptr));
+        for (size_t i = 8; i-- > 0; list = list->next)
+        {
+            MEM_ASSERT((uint8_t *)list >= dst->ptr && (uint8_t *)list < dst->ptr + dst->len);
+            MEM_ASSERT(list->value == i);
+        }
+        MEM_ASSERT(!list);
+
+        // NOTE (Matteo): Corrupted snapshots are rejected
+        memClear(dst);
+        result = memSnapshotLoad(dst, (MemBlock){.ptr = block.ptr, .len = block.len - 1});
+        MEM_ASSERT(!result && dst->len == 0);
+        block.ptr[0] ^= 0xFF;
+        result = memSnapshotLoad(dst, block);
+        MEM_ASSERT(!result && dst->len == 0);
+
+        result = memFree(mem, &block);
+        MEM_ASSERT(result);
+        memRelease(dst);
+        memRelease(src);
+    }
+
+#if !defined(_WIN32) && UINTPTR_MAX > 0xFFFFFFFF
+    // NOTE (Matteo): Persistent arena
+    {
+        typedef struct Node
+        {
+            struct Node *next;
+            uint32_t value;
+        } Node;
+
+        char const *path = "mem_test.arena";
+        MemArenaInfo info = {
+            .available_size = MEM_MB(64),
+            .file_path = path,
+            // NOTE (Matteo): Away from the ranges used by the address sanitizer
+            .base_address = (void *)(uintptr_t)0x500000000000,
+        };
+
+        remove(path);
+
+        MemArena *persist = memReserve(&info);
+        MEM_ASSERT(persist && (void *)persist == info.base_address);
+
+        Node *head = memAllocStruct(persist, Node);
+        head->value = 1;
+        head->next = memAllocStruct(persist, Node);
+        head->next->value = 2;
+
+        // NOTE (Matteo): Released memory is cleared, even if the file retains it
+        block = memAlloc(persist, MEM_MB(1), 1);
+        MEM_SET(block.ptr, 0xFF, block.len);
+        result = memFree(persist, &block);
+        MEM_ASSERT(result);
+        block = memAlloc(persist, MEM_MB(1), 1);
+        MEM_ASSERT(block.ptr[0] == 0 && block.ptr[block.len - 1] == 0);
+        result = memFree(persist, &block);
+        MEM_ASSERT(result);
+
+        result = memSync(persist);
+        MEM_ASSERT(result);
+        size_t len = persist->len;
+        memRelease(persist);
+
+        // NOTE (Matteo): Reopening restores the arena with valid pointers, ignoring the options
+        info.available_size = MEM_MB(1);
+        persist = memReserve(&info);
+        MEM_ASSERT(persist && persist->len == len && persist->cap == MEM_MB(64));
+        head = (Node *)persist->ptr;
+        MEM_ASSERT(head->value == 1 && head->next->value == 2 && !head->next->next);
+        Node *node = memAllocStruct(persist, Node);
+        MEM_ASSERT(node && node->value == 0 && (uint8_t *)node >= persist->ptr + len);
+
+        // NOTE (Matteo): The address range cannot be mapped twice
+        MemArena *twice = memReserve(&info);
+        MEM_ASSERT(!twice);
+
+        memRelease(persist);
+
+        // NOTE (Matteo): The file must be reopened in the mode it was created with
+        info.shared = true;
+        MEM_ASSERT(!memReserve(&info));
+        remove(path);
+
+        persist = memReserve(&info);
+        MEM_ASSERT(persist);
+        uint32_t *value = memAllocStruct(persist, uint32_t);
+        *value = 42;
+        memRelease(persist);
+
+        info.shared = false;
+        MEM_ASSERT(!memReserve(&info));
+
+        info.shared = true;
+        persist = memReserve(&info);
+        MEM_ASSERT(persist && *(uint32_t *)persist->ptr == 42);
+        memRelease(persist);
+        remove(path);
+    }
+#endif
+
+    // NOTE (Matteo): Copy-on-write clones
+    {
+        MemArena *base = memReserve(&(MemArenaInfo){
+            .available_size = MEM_MB(16),
+            .cloneable = true,
+        });
+        MEM_ASSERT(base);
+
+        block = memAlloc(base, MEM_MB(2), 16);
+        MEM_SET(block.ptr, 0xAB, block.len);
+
+        MemArena *clone = memClone(base);
+#if defined(__linux__)
+        MEM_ASSERT(clone);
+#endif
+        if (clone)
+        {
+            MEM_ASSERT(clone != base && clone->len == base->len);
+            uint8_t *copy = clone->ptr + (block.ptr - base->ptr);
+            MEM_ASSERT(copy[0] == 0xAB && copy[block.len - 1] == 0xAB);
+
+            // NOTE (Matteo): Writes of the clone are private
+            copy[0] = 0xCD;
+            MEM_ASSERT(block.ptr[0] == 0xAB);
+
+            // NOTE (Matteo): Released memory of the clone is cleared
+            MemBlock clone_block = {.ptr = copy, .len = block.len};
+            result = memFree(clone, &clone_block);
+            MEM_ASSERT(result);
+            clone_block = memAlloc(clone, MEM_MB(2), 16);
+            MEM_ASSERT(clone_block.ptr[0] == 0 && clone_block.ptr[clone_block.len - 1] == 0);
+            MEM_ASSERT(block.ptr[1] == 0xAB);
+
+            memRelease(clone);
+        }
+
+        memRelease(base);
+    }
+
+#if !defined(_WIN32)
+    // NOTE (Matteo): Shared arena
+    {
+        MemArena *shared = memReserve(&(MemArenaInfo){
+            .available_size = MEM_MB(16),
+            .shared = true,
+        });
+        MEM_ASSERT(shared);
+
+        MemRef *root = memAllocStruct(shared, MemRef);
+
+        pid_t pid = fork();
+        MEM_ASSERT(pid >= 0);
+
+        if (pid == 0)
+        {
+            // NOTE (Matteo): Allocations of the child process are visible to the parent
+            uint32_t *value = memAllocStruct(shared, uint32_t);
+            *value = 42;
+            *root = memRefOf(shared, uint32_t, value);
+            _exit(0);
+        }
+
+        int status;
+        waitpid(pid, &status, 0);
+        MEM_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        MEM_ASSERT(root->val && *memRefGet(shared, uint32_t, *root) == 42);
+
+        uint32_t *other = memAllocStruct(shared, uint32_t);
+        MEM_ASSERT(other && other > memRefGet(shared, uint32_t, *root));
+
+        memClear(shared);
+        memRelease(shared);
+    }
+#endif
+
     Buf buf = {.mem = mem};
     for (uint32_t i = 0; i < 10; ++i)
     {
@@ -57,5 +1075,7 @@ main(void)
 
     MEM_ASSERT(bufFree(&buf));
 
+    memRelease(mem);
+
     return 0;
 }